@@ -0,0 +1,191 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : bench_mc_scaling.cpp
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Strong and weak scaling of the MC polynomial sweep (the K = 1
+//        : loop of TestMonteCarlo in monte_carlo_integration.cpp).
+//
+// For every polynomial count M and sample count N the sweep is run at each
+// thread count T; strong scaling keeps M fixed, weak scaling (-weak) runs
+// M*T/T0 polynomials so the work per thread stays fixed (T0 the first
+// thread count). Efficiency is against the T0 run:
+//   strong: t0*T0/(t*T)   weak: t0/t
+// and samples/s/core divides by min(T, processors).
+// Every thread records the wall time it spent inside polynomials (busy),
+// its CPU time over the parallel loop and how many polynomials it ran.
+// Busy well below wall time is load imbalance; CPU time well below busy
+// time means the thread was descheduled (oversubscription, SMT siblings,
+// other jobs); busy time that grows with T at equal per thread work points
+// at shared cache lines or memory bandwidth.
+//
+// Results go to PREFIX_runs.csv (one row per run) and PREFIX_threads.csv
+// (one row per thread per run), and a summary table to stdout.
+// g++ -O3 -march=native -std=c++17 -fopenmp bench_mc_scaling.cpp -o bench_mc_scaling
+////////////////////////////////////////////////////////////////////////////////
+
+#include "polynomial.h"
+#include "monte_carlo_integration.h"
+#include "checkpoint.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <omp.h>
+#ifdef __linux__
+#include <time.h>
+#endif
+
+using namespace MonteCarloIntegration;
+
+// Per thread counters, one cache line each so the benchmark itself does
+// not false share.
+struct alignas(64) ThreadTimes {
+  double busy = 0, cpu = 0;
+  uint64_t polynomials = 0;
+};
+
+struct RunResult {
+  double wall;
+  double max_rel_error;
+  std::vector<ThreadTimes> threads;
+};
+
+static double ThreadCPUSeconds()
+{
+#ifdef __linux__
+  timespec ts;
+  clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+#else
+  return omp_get_wtime(); // no per thread clock: cpu == wall
+#endif
+}
+
+// Polynomial i of the driver: same seeds, streams and kernel.
+static double PolynomialError( int N, uint64_t SEED, uint64_t i )
+{
+  Polynomial<double,10> px;
+  px.RandomCoefficients( CHECKPOINT::item_seed( SEED, 2*i ) );
+  const double A = 1.15, B = 2.23;
+  BatchMCI m(A,B,N,px.horner(),SEED,i);
+  const double pc_int = px.Integral(A,B);
+  return 100.0*std::abs( pc_int-m.Integral() )/pc_int;
+}
+
+static RunResult Sweep( int T, int M, int N, uint64_t SEED )
+{
+  RunResult retval{ 0, 0, std::vector<ThreadTimes>( T ) };
+  double max_rel_error = 0;
+  const auto start = std::chrono::steady_clock::now();
+  #pragma omp parallel num_threads(T) reduction(max:max_rel_error)
+  {
+    ThreadTimes& mine = retval.threads[omp_get_thread_num()];
+    const double cpu0 = ThreadCPUSeconds();
+    #pragma omp for schedule(static)
+    for( int i=0; i < M; ++i ) {
+      const double t0 = omp_get_wtime();
+      max_rel_error = std::max( max_rel_error, PolynomialError( N, SEED, i ) );
+      mine.busy += omp_get_wtime()-t0;
+      mine.polynomials++;
+    }
+    mine.cpu = ThreadCPUSeconds()-cpu0;
+  }
+  retval.wall = std::chrono::duration<double>( std::chrono::steady_clock::now()-start ).count();
+  retval.max_rel_error = max_rel_error;
+  return retval;
+}
+
+static std::vector<int> ParseList( const std::string& s )
+{
+  std::vector<int> retval;
+  std::istringstream is( s );
+  std::string item;
+  while( std::getline( is, item, ',' ) ) if( !item.empty() ) retval.push_back( atoi( item.c_str() ) );
+  return retval;
+}
+
+static void Usage( const char* progName )
+{
+  std::cerr << progName << " [-threads 1,2,4,..] [-polynomials M,..] [-samples N,..] [-weak] [-seed S] [-csv PREFIX]\n"
+	    << "\tdefaults: threads 1,2,4,.. up to the processors, polynomials 8*max threads,\n"
+	    << "\tsamples 100000,1000000, strong scaling, PREFIX bench_mc_scaling" << std::endl;
+  exit(-1);
+}
+
+int main(int argc, char* argv[])
+{
+  const int PROCS = omp_get_num_procs();
+  std::vector<int> threads, polynomials, samples{ 100000, 1000000 };
+  bool weak = false;
+  uint64_t SEED = 1;
+  std::string prefix = "bench_mc_scaling";
+  for( int i=1; i < argc; ++i ) {
+    const std::string arg = argv[i];
+    if( arg == "-weak" ) { weak = true; continue; }
+    if( i+1 >= argc ) Usage( argv[0] );
+    if( arg == "-threads" ) threads = ParseList( argv[++i] );
+    else if( arg == "-polynomials" ) polynomials = ParseList( argv[++i] );
+    else if( arg == "-samples" ) samples = ParseList( argv[++i] );
+    else if( arg == "-seed" ) SEED = std::stoull( argv[++i] );
+    else if( arg == "-csv" ) prefix = argv[++i];
+    else Usage( argv[0] );
+  }
+  if( threads.empty() ) {
+    for( int t=1; t < PROCS; t *= 2 ) threads.push_back( t );
+    threads.push_back( PROCS );
+  }
+  int max_threads = 0;
+  for( int t : threads ) {
+    if( t <= 0 ) Usage( argv[0] );
+    max_threads = std::max( max_threads, t );
+  }
+  if( polynomials.empty() ) polynomials.push_back( 8*max_threads );
+
+  std::ofstream runs( prefix + "_runs.csv" ), per_thread( prefix + "_threads.csv" );
+  runs << "mode,threads,procs,polynomials,samples,wall_s,samples_per_s,samples_per_s_per_core,efficiency,"
+       << "busy_min_s,busy_max_s,busy_mean_s,cpu_mean_s,imbalance,max_rel_error\n";
+  per_thread << "mode,threads,polynomials,samples,thread,busy_s,cpu_s,polynomials_run\n";
+  const char* mode = weak ? "weak" : "strong";
+
+  std::cout << "Processors = " << PROCS << ", " << mode << " scaling\n";
+  std::cout << std::setw(8) << "T" << std::setw(10) << "M" << std::setw(10) << "N" << std::setw(12) << "wall s"
+	    << std::setw(16) << "samples/s/core" << std::setw(12) << "efficiency" << std::setw(12) << "imbalance"
+	    << std::setw(12) << "cpu/busy" << "\n";
+  for( int M0 : polynomials ) {
+    for( int N : samples ) {
+      double base = 0;
+      for( size_t k=0; k < threads.size(); ++k ) {
+	const int T = threads[k];
+	const int M = weak ? static_cast<int>( uint64_t(M0)*T/threads.front() ) : M0;
+	const RunResult r = Sweep( T, M, N, SEED );
+	if( k == 0 ) base = r.wall*( weak ? 1 : threads.front() );
+	const double efficiency = weak ? base/r.wall : base/( r.wall*T );
+	const double rate = double(M)*N/r.wall;
+	const int cores = std::min( T, PROCS );
+	double busy_min = r.threads[0].busy, busy_max = 0, busy_sum = 0, cpu_sum = 0;
+	for( int t=0; t < T; ++t ) {
+	  const ThreadTimes& tt = r.threads[t];
+	  busy_min = std::min( busy_min, tt.busy );
+	  busy_max = std::max( busy_max, tt.busy );
+	  busy_sum += tt.busy;
+	  cpu_sum += tt.cpu;
+	  per_thread << mode << "," << T << "," << M << "," << N << "," << t << "," << tt.busy << "," << tt.cpu
+		     << "," << tt.polynomials << "\n";
+	}
+	// Slowest thread against the mean: 1 is perfectly balanced.
+	const double imbalance = ( busy_sum > 0 ) ? busy_max/( busy_sum/T ) : 1.0;
+	runs << mode << "," << T << "," << PROCS << "," << M << "," << N << "," << r.wall << "," << rate << ","
+	     << rate/cores << "," << efficiency << "," << busy_min << "," << busy_max << "," << busy_sum/T << ","
+	     << cpu_sum/T << "," << imbalance << "," << r.max_rel_error << "\n";
+	std::cout << std::setw(8) << T << std::setw(10) << M << std::setw(10) << N << std::setw(12) << r.wall
+		  << std::setw(16) << rate/cores << std::setw(12) << efficiency << std::setw(12) << imbalance
+		  << std::setw(12) << ( busy_sum > 0 ? cpu_sum/busy_sum : 0.0 )
+		  << ( T > PROCS ? "  oversubscribed" : "" ) << std::endl;
+      }
+    }
+  }
+  return ( EXIT_SUCCESS );
+}
@@ -0,0 +1,97 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : bench_numa.cpp
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Memory bound STREAM style triad on ThreadPool with each PLACEMENT.
+//        : Every worker slot first-touches its own arrays, then each pass
+//        : runs one triad task per slot; a task works on the arrays of the
+//        : slot it lands on. Pinned workers keep reading node local pages,
+//        : floating ones end up reading remote memory.
+// g++ -O2 -Wall -std=c++17 bench_numa.cpp -o bench_numa -pthread
+////////////////////////////////////////////////////////////////////////////////
+
+#include "threadpool.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+
+using namespace THREAD_POOL;
+
+struct SlotArrays {
+  std::unique_ptr<double[]> a, b, c;
+};
+
+// One task per slot; a task claims the arrays of the slot running it, or
+// any unclaimed set if that one is taken (a worker picked up two tasks).
+template <typename KERNEL>
+static void RunPass( ThreadPool& pool, std::vector<SlotArrays>& arrays,
+		     std::unique_ptr<std::atomic<bool>[]>& claimed, const KERNEL& kernel )
+{
+  const unsigned int T = static_cast<unsigned int>( arrays.size() );
+  for( unsigned int i=0; i < T; ++i ) claimed[i] = false;
+  std::atomic<unsigned int> remaining{T};
+  for( unsigned int i=0; i < T; ++i ) {
+    pool.add( [&,T]() {
+	unsigned int s = pool.worker_index();
+	if( s >= T || claimed[s].exchange( true ) ) {
+	  for( s=0; s < T && claimed[s].exchange( true ); ++s ) {}
+	}
+	if( s < T ) kernel( arrays[s] );
+	remaining.fetch_sub( 1 );
+      } );
+  }
+  pool.help_while( [&]() { return remaining.load() != 0; } );
+}
+
+static double Triad( PLACEMENT P, unsigned int T, size_t N, unsigned int PASSES )
+{
+  ThreadPool pool{T, SCHEDULING::WORK_STEALING, P};
+  pool.start();
+  std::vector<SlotArrays> arrays( T );
+  std::unique_ptr<std::atomic<bool>[]> claimed( new std::atomic<bool>[T] );
+  for( auto& s : arrays ) {
+    s.a.reset( new double[N] );
+    s.b.reset( new double[N] );
+    s.c.reset( new double[N] );
+  }
+  // First touch decides which node the pages live on.
+  RunPass( pool, arrays, claimed, [N]( SlotArrays& s ) {
+      for( size_t i=0; i < N; ++i ) { s.a[i] = 0; s.b[i] = 1; s.c[i] = 2; }
+    } );
+  const double q = 3.0;
+  auto start = std::chrono::steady_clock::now();
+  for( unsigned int p=0; p < PASSES; ++p ) {
+    RunPass( pool, arrays, claimed, [N,q]( SlotArrays& s ) {
+	double* a = s.a.get();
+	const double* b = s.b.get();
+	const double* c = s.c.get();
+	for( size_t i=0; i < N; ++i ) a[i] = b[i] + q*c[i];
+      } );
+  }
+  const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now()-start ).count();
+  return 3.0*sizeof(double)*N*T*PASSES/seconds*1e-9; // GB/s moved
+}
+
+static void Usage( const char* progName )
+{
+  std::cout << progName << " T (threads) N (doubles per array per thread) P (passes)" << std::endl;
+  exit(-1);
+}
+int main(int argc, char* argv[])
+{
+  if( argc != 4 ) Usage( argv[0] );
+  const unsigned int T = atoi( argv[1] );
+  const size_t N = atol( argv[2] );
+  const unsigned int P = atoi( argv[3] );
+  if( T == 0 || N == 0 || P == 0 ) Usage( argv[0] );
+  const CpuTopology topology = CpuTopology::discover();
+  std::cout << "Found " << topology.node_count() << " NUMA node(s):";
+  for( size_t n=0; n < topology.node_count(); ++n ) std::cout << " " << topology.node_cpus(n).size();
+  std::cout << " CPUs\n";
+  std::cout << std::setw(12) << "NONE"       << "\t" << Triad( PLACEMENT::NONE, T, N, P )       << " GB/s\n";
+  std::cout << std::setw(12) << "CORES"      << "\t" << Triad( PLACEMENT::CORES, T, N, P )      << " GB/s\n";
+  std::cout << std::setw(12) << "NUMA_NODES" << "\t" << Triad( PLACEMENT::NUMA_NODES, T, N, P ) << " GB/s" << std::endl;
+  return (0);
+}
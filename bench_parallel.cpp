@@ -0,0 +1,135 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : bench_parallel.cpp
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Collatz max search and the MC polynomial sweep (TestMonteCarlo)
+//        : run on parallel_reduce over ThreadPool and on OpenMP; the Collatz
+//        : search also on CollatzRangeEngine.
+// g++ -O2 -Wall -std=c++17 -fopenmp bench_parallel.cpp -o bench_parallel -lgmpxx -lgmp
+// Add -DTHREAD_POOL_STATS for per worker statistics and bench_parallel_trace.json.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "parallel_algorithms.h"
+#include "collatz_range.h"
+#include "polynomial.h"
+#include "monte_carlo_integration.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <omp.h>
+
+using namespace THREAD_POOL;
+using namespace MonteCarloIntegration;
+
+using COLLATZ_MAX = std::pair<unsigned int, unsigned int>;
+
+static COLLATZ_MAX better( const COLLATZ_MAX& a, const COLLATZ_MAX& b )
+{
+  if( a.second != b.second ) return ( a.second > b.second ) ? a : b;
+  return ( a.first < b.first ) ? a : b;
+}
+
+static COLLATZ_MAX CollatzPool( ThreadPool& pool, unsigned int M )
+{
+  return parallel_reduce( pool, 1u, M+1, COLLATZ_MAX{1,1},
+			  []( unsigned int n ) { return COLLATZ_MAX{ n, static_cast<unsigned int>( collatz_count( n ) ) }; },
+			  better );
+}
+
+static COLLATZ_MAX CollatzOpenMP( unsigned int M )
+{
+  COLLATZ_MAX retval{1,1};
+  #pragma omp parallel
+  {
+    COLLATZ_MAX local{1,1};
+    #pragma omp for schedule(dynamic,256) nowait
+    for( unsigned int n=1; n <= M; ++n ) local = better( local, COLLATZ_MAX{ n, static_cast<unsigned int>( collatz_count( n ) ) } );
+    #pragma omp critical
+    retval = better( retval, local );
+  }
+  return retval;
+}
+
+static COLLATZ_MAX CollatzEngine( ThreadPool& pool, const CollatzRangeEngine& engine, unsigned int M )
+{
+  const CollatzRecord r = engine.search( pool, 1, M+1ull );
+  return COLLATZ_MAX{ static_cast<unsigned int>( r.NUM ), r.count };
+}
+
+// One polynomial of TestMonteCarlo: relative error of MC against the exact integral.
+static double PolynomialError( int N )
+{
+  Polynomial<double> px(10);
+  px.RandomCoefficients();
+  const double A = 1.15, B = 2.23;
+  auto f{px.getHorner()};
+  MCI m(A,B,N,f);
+  const double pc_int = px.Integral(A,B);
+  return 100.0*std::abs( pc_int-m.Integral() )/pc_int;
+}
+
+static double SweepPool( ThreadPool& pool, int M, int N )
+{
+  return parallel_reduce( pool, 0, M, 0.0, [N]( int ) { return PolynomialError( N ); },
+			  []( double a, double b ) { return std::max( a, b ); }, 1 );
+}
+
+static double SweepOpenMP( int M, int N )
+{
+  double max_rel_error = 0;
+  #pragma omp parallel for reduction(max:max_rel_error)
+  for( int i=0; i < M; ++i ) max_rel_error = std::max( max_rel_error, PolynomialError( N ) );
+  return max_rel_error;
+}
+
+template <typename F>
+static double Seconds( F&& f )
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>( std::chrono::steady_clock::now()-start ).count();
+}
+
+static void Usage( const char* progName )
+{
+  std::cout << progName << " T (threads) C (collatz range) M (polynomials) N (trials)" << std::endl;
+  exit(-1);
+}
+int main(int argc, char* argv[])
+{
+  if( argc != 5 ) Usage( argv[0] );
+  const unsigned int T = atoi( argv[1] );
+  const unsigned int C = atoi( argv[2] );
+  const int M = atoi( argv[3] );
+  const int N = atoi( argv[4] );
+  if( T == 0 ) Usage( argv[0] );
+  omp_set_num_threads( T );
+  ThreadPool pool{T, SCHEDULING::WORK_STEALING};
+  pool.start();
+#ifdef THREAD_POOL_STATS
+  pool.tracing( true );
+#endif
+
+  const CollatzRangeEngine engine;
+  COLLATZ_MAX cp, co, ce;
+  double sp = 0, so = 0;
+  const double t_cp = Seconds( [&]() { cp = CollatzPool( pool, C ); } );
+  const double t_co = Seconds( [&]() { co = CollatzOpenMP( C ); } );
+  const double t_ce = Seconds( [&]() { ce = CollatzEngine( pool, engine, C ); } );
+  const double t_sp = Seconds( [&]() { sp = SweepPool( pool, M, N ); } );
+  const double t_so = Seconds( [&]() { so = SweepOpenMP( M, N ); } );
+  std::cout << "Threads = " << T << "\n";
+  std::cout << std::setw(20) << "collatz pool"   << "\t" << std::setw(10) << t_cp << " s\t" << cp.first << "\t" << cp.second << "\n";
+  std::cout << std::setw(20) << "collatz openmp" << "\t" << std::setw(10) << t_co << " s\t" << co.first << "\t" << co.second << "\n";
+  std::cout << std::setw(20) << "collatz engine" << "\t" << std::setw(10) << t_ce << " s\t" << ce.first << "\t" << ce.second << "\n";
+  std::cout << std::setw(20) << "mc sweep pool"  << "\t" << std::setw(10) << t_sp << " s\tMAX REL ERROR := " << sp << "\n";
+  std::cout << std::setw(20) << "mc sweep openmp"<< "\t" << std::setw(10) << t_so << " s\tMAX REL ERROR := " << so << std::endl;
+#ifdef THREAD_POOL_STATS
+  write_stats( std::cout, pool.stats() );
+  std::ofstream trace( "bench_parallel_trace.json" );
+  pool.write_trace( trace );
+#endif
+  return ( cp == co && cp == ce ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
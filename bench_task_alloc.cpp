@@ -0,0 +1,116 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : bench_task_alloc.cpp
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Count heap allocations per task on the ThreadPool enqueue/dequeue
+//        : path. Global operator new is replaced by a counting version; the
+//        : old std::queue<std::function> scheme is measured for reference.
+// g++ -O2 -Wall -std=c++17 bench_task_alloc.cpp -o bench_task_alloc -pthread
+////////////////////////////////////////////////////////////////////////////////
+
+#include "threadpool.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <queue>
+#include <chrono>
+#include <cstdlib>
+#include <array>
+
+static std::atomic<unsigned long> ALLOCATIONS{0};
+
+// new allocates with std::malloc and both deletes release with std::free.
+// All three stay out of line like a library replacement: inlined into the
+// standard containers, GCC pairs malloc/free with the operator new/delete
+// calls left there and reports -Wmismatched-new-delete.
+__attribute__(( noinline )) void* operator new( size_t size )
+{
+  ALLOCATIONS.fetch_add( 1, std::memory_order_relaxed );
+  if( void* p = std::malloc( size ? size : 1 ) ) return p;
+  throw std::bad_alloc();
+}
+__attribute__(( noinline )) void operator delete( void* p ) noexcept { std::free( p ); }
+__attribute__(( noinline )) void operator delete( void* p, size_t ) noexcept { std::free( p ); }
+
+using namespace THREAD_POOL;
+
+static std::atomic<unsigned long> SINK{0};
+
+struct Measurement { double allocations_per_task; double seconds; };
+
+// Tasks are added from the main thread while T workers drain them. The first
+// round grows the rings to the working set and is not counted.
+template <typename MAKE_TASK>
+static Measurement MeasurePool( SCHEDULING MODE, unsigned int T, unsigned int M, MAKE_TASK make_task )
+{
+  ThreadPool pool{T, MODE};
+  std::vector<std::thread> threads;
+  threads.reserve( T );
+  for( unsigned int i=0; i < T; ++i ) threads.push_back( std::thread( &ThreadPool::run, &pool ) );
+  for( unsigned int i=0; i < M; ++i ) pool.add( make_task( i ) );
+  while( SINK.load() < M ) std::this_thread::yield();
+  const unsigned long before = ALLOCATIONS.load();
+  auto start = std::chrono::steady_clock::now();
+  for( unsigned int i=0; i < M; ++i ) pool.add( make_task( i ) );
+  while( SINK.load() < 2ul*M ) std::this_thread::yield();
+  auto stop = std::chrono::steady_clock::now();
+  const unsigned long after = ALLOCATIONS.load();
+  pool.complete();
+  for( auto& t : threads ) t.join();
+  SINK = 0;
+  return Measurement{ (after-before)/(double)M, std::chrono::duration<double>( stop-start ).count() };
+}
+
+// Reference: the pre-Task queue, copy out of front() then pop().
+template <typename MAKE_TASK>
+static Measurement MeasureStdFunctionQueue( unsigned int M, MAKE_TASK make_task )
+{
+  std::queue< std::function<void()> > task_queue;
+  const unsigned long before = ALLOCATIONS.load();
+  auto start = std::chrono::steady_clock::now();
+  for( unsigned int i=0; i < M; ++i ) task_queue.emplace( make_task( i ) );
+  while( !task_queue.empty() ) {
+    std::function<void()> func = task_queue.front();
+    task_queue.pop();
+    func();
+  }
+  auto stop = std::chrono::steady_clock::now();
+  const unsigned long after = ALLOCATIONS.load();
+  SINK = 0;
+  return Measurement{ (after-before)/(double)M, std::chrono::duration<double>( stop-start ).count() };
+}
+
+static void Report( const char* name, unsigned int M, const Measurement& R )
+{
+  std::cout << std::setw(28) << name << "\t" << std::setw(8) << R.allocations_per_task << " allocs/task\t"
+	    << std::setw(10) << 1e9*R.seconds/M << " ns/task" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  const unsigned int T = ( argc > 1 ) ? atoi( argv[1] ) : 2;
+  const unsigned int M = ( argc > 2 ) ? atoi( argv[2] ) : 100000;
+  // 8 bytes of capture: fits std::function's buffer and Task's.
+  auto small = []( unsigned int i ) { return [i]() { (void)i; SINK.fetch_add( 1 ); }; };
+  // 40 bytes of capture: too big for std::function, still inline in Task.
+  auto medium = []( unsigned int i ) {
+    std::array<unsigned long, 5> payload{ i, i, i, i, i };
+    return [payload]() { (void)payload; SINK.fetch_add( 1 ); };
+  };
+  // 128 bytes of capture: heap allocated by both.
+  auto large = []( unsigned int i ) {
+    std::array<unsigned long, 16> payload{};
+    payload[0] = i;
+    return [payload]() { (void)payload; SINK.fetch_add( 1 ); };
+  };
+  std::cout << "Allocation count with " << T << " threads and " << M << " tasks.\n";
+  Report( "std::function small",  M, MeasureStdFunctionQueue( M, small ) );
+  Report( "std::function medium", M, MeasureStdFunctionQueue( M, medium ) );
+  Report( "std::function large",  M, MeasureStdFunctionQueue( M, large ) );
+  Report( "global small",   M, MeasurePool( SCHEDULING::GLOBAL_QUEUE, T, M, small ) );
+  Report( "global medium",  M, MeasurePool( SCHEDULING::GLOBAL_QUEUE, T, M, medium ) );
+  Report( "global large",   M, MeasurePool( SCHEDULING::GLOBAL_QUEUE, T, M, large ) );
+  Report( "stealing small", M, MeasurePool( SCHEDULING::WORK_STEALING, T, M, small ) );
+  Report( "stealing medium",M, MeasurePool( SCHEDULING::WORK_STEALING, T, M, medium ) );
+  Report( "stealing large", M, MeasurePool( SCHEDULING::WORK_STEALING, T, M, large ) );
+  return (0);
+}
@@ -0,0 +1,112 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : bench_threadpool.cpp
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Compare GLOBAL_QUEUE and WORK_STEALING scheduling on fine grained
+//        : Collatz tasks, submitted flat from main and spawned recursively.
+// g++ -O2 -Wall -std=c++17 bench_threadpool.cpp -o bench_threadpool -pthread
+////////////////////////////////////////////////////////////////////////////////
+
+#include "threadpool.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+using namespace THREAD_POOL;
+
+// Native arithmetic keeps the task tiny so the scheduler cost dominates.
+static unsigned int collatz_steps( unsigned long long n )
+{
+  unsigned int retval = 1;
+  while( n != 1 ) {
+    n = ( n & 1 ) ? 3*n+1 : n/2;
+    retval++;
+  }
+  return retval;
+}
+
+struct BenchResult { double seconds; unsigned int max_steps; };
+
+// Flat: main thread adds M independent tasks, one by one or as one batch.
+static BenchResult RunFlat( SCHEDULING MODE, unsigned int T, unsigned int M, bool BATCH = false )
+{
+  ThreadPool pool{T, MODE};
+  std::vector<unsigned int> steps(M);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for( unsigned int i=0; i < T; ++i ) threads.push_back( std::thread( &ThreadPool::run, &pool ) );
+  if( BATCH ) {
+    pool.add_range( 0, M, [&steps]( size_t i ) { steps[i] = collatz_steps( i+1 ); } );
+  } else {
+    for( unsigned int i=0; i < M; ++i ) {
+      pool.add( [&steps,i]() { steps[i] = collatz_steps( i+1 ); } );
+    }
+  }
+  pool.complete();
+  for( auto& t : threads ) t.join();
+  auto stop = std::chrono::steady_clock::now();
+  unsigned int max_steps = 0;
+  for( auto s : steps ) max_steps = std::max( max_steps, s );
+  return BenchResult{ std::chrono::duration<double>( stop-start ).count(), max_steps };
+}
+
+// Recursive: tasks split their range in half and add the halves back to the
+// pool, so most adds come from worker threads.
+static void SplitRange( ThreadPool& pool, std::vector<unsigned int>& steps,
+			std::atomic<unsigned int>& remaining, unsigned int lo, unsigned int hi )
+{
+  while( hi-lo > 64 ) {
+    unsigned int mid = lo + (hi-lo)/2;
+    remaining.fetch_add( 1 );
+    pool.add( [&pool,&steps,&remaining,mid,hi]() { SplitRange( pool, steps, remaining, mid, hi ); } );
+    hi = mid;
+  }
+  for( unsigned int i=lo; i < hi; ++i ) steps[i] = collatz_steps( i+1 );
+  remaining.fetch_sub( 1 );
+}
+
+static BenchResult RunRecursive( SCHEDULING MODE, unsigned int T, unsigned int M )
+{
+  ThreadPool pool{T, MODE};
+  std::vector<unsigned int> steps(M);
+  std::atomic<unsigned int> remaining{1};
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for( unsigned int i=0; i < T; ++i ) threads.push_back( std::thread( &ThreadPool::run, &pool ) );
+  pool.add( [&pool,&steps,&remaining,M]() { SplitRange( pool, steps, remaining, 0, M ); } );
+  while( remaining.load() != 0 ) std::this_thread::yield();
+  pool.complete();
+  for( auto& t : threads ) t.join();
+  auto stop = std::chrono::steady_clock::now();
+  unsigned int max_steps = 0;
+  for( auto s : steps ) max_steps = std::max( max_steps, s );
+  return BenchResult{ std::chrono::duration<double>( stop-start ).count(), max_steps };
+}
+
+static void Report( const char* name, unsigned int M, const BenchResult& R )
+{
+  std::cout << std::setw(24) << name << "\t" << std::setw(10) << R.seconds << " s\t"
+	    << std::setw(12) << M/R.seconds << " tasks/s\t max = " << R.max_steps << std::endl;
+}
+
+static void Usage( const char* progName )
+{
+  std::cout << progName << " T (threads) M (number-tasks)" << std::endl;
+  exit(-1);
+}
+int main(int argc, char* argv[])
+{
+  if( argc != 3 ) Usage( argv[0] );
+  const unsigned int T = atoi( argv[1] );
+  const unsigned int M = atoi( argv[2] );
+  if( T == 0 || M == 0 ) Usage( argv[0] );
+  std::cout << "Benchmark with " << T << " threads and " << M << " tasks.\n";
+  Report( "global flat",      M, RunFlat( SCHEDULING::GLOBAL_QUEUE, T, M ) );
+  Report( "stealing flat",    M, RunFlat( SCHEDULING::WORK_STEALING, T, M ) );
+  Report( "global batch",     M, RunFlat( SCHEDULING::GLOBAL_QUEUE, T, M, true ) );
+  Report( "stealing batch",   M, RunFlat( SCHEDULING::WORK_STEALING, T, M, true ) );
+  Report( "global recursive", M, RunRecursive( SCHEDULING::GLOBAL_QUEUE, T, M ) );
+  Report( "stealing recursive", M, RunRecursive( SCHEDULING::WORK_STEALING, T, M ) );
+  return (0);
+}
@@ -0,0 +1,254 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : checkpoint.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Deterministic sharding, checkpoint files and merging for the long
+//        : running drivers (collatz_search, monte_carlo_integration)
+//
+// A run covers work items [lo,hi). "-shard i/S" gives this process the i-th
+// of S equal slices, so S processes (on one or several machines) cover the
+// range exactly once. Drivers advance through their slice in order and every
+// "-interval" seconds rewrite "-checkpoint FILE": the run parameters, the
+// slice, the first item not yet done and the partial results, as one short
+// text file. The file is written to FILE.tmp and renamed over FILE, so a
+// crash leaves either the old or the new checkpoint. Started again with the
+// same arguments a driver resumes from the checkpoint; "-merge F1 F2 ..."
+// folds the checkpoints of all shards into the final result and reports
+// gaps, overlaps, missing and unfinished shards. Every checkpoint records
+// the whole range and the shard count, so a merge can tell that the first
+// or last shards are missing.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <optional>
+#include <algorithm>
+#include <limits>
+
+#pragma once
+
+namespace CHECKPOINT {
+
+  // Deterministic 64 bit seed for work item index, so results do not depend
+  // on which shard, thread or restart computed the item (splitmix64).
+  inline uint64_t item_seed( uint64_t seed, uint64_t index ) {
+    uint64_t z = seed + ( index+1 )*0x9E3779B97F4A7C15ull;
+    z = ( z ^ ( z >> 30 ) )*0xBF58476D1CE4E5B9ull;
+    z = ( z ^ ( z >> 27 ) )*0x94D049BB133111EBull;
+    return z ^ ( z >> 31 );
+  }
+
+  struct Shard {
+    unsigned int index = 0, count = 1;
+    // Slice of [lo,hi); slices of all indices partition the range.
+    std::pair<uint64_t,uint64_t> slice( uint64_t lo, uint64_t hi ) const {
+      const uint64_t q = (hi-lo)/count, r = (hi-lo)%count;
+      auto start = [&]( uint64_t i ) { return lo + q*i + std::min<uint64_t>( i, r ); };
+      return { start( index ), start( index+1 ) };
+    }
+  };
+
+  class Checkpoint {
+  public:
+    std::string driver;  // which program wrote it
+    std::string params;  // run parameters; must match to resume or merge
+    uint64_t lo = 0, hi = 0;                // range of the whole run
+    unsigned int shards = 0;                // and the number of slices it is split into
+    uint64_t first = 0, last = 0, next = 0; // slice and progress: [first,next) done
+    bool complete() const { return next >= last; }
+
+    void set( const std::string& key, uint64_t v ) { results[key] = std::to_string( v ); }
+    void set( const std::string& key, double v ) {
+      std::ostringstream os;
+      os << std::setprecision( std::numeric_limits<double>::max_digits10 ) << v;
+      results[key] = os.str();
+    }
+    uint64_t get_u64( const std::string& key ) const { return std::stoull( value( key ) ); }
+    double get_double( const std::string& key ) const { return std::stod( value( key ) ); }
+    bool has( const std::string& key ) const { return results.count( key ) != 0; }
+
+    bool write( const std::string& path ) const {
+      const std::string tmp = path + ".tmp";
+      {
+	std::ofstream os( tmp, std::ios::trunc );
+	if( !os ) return false;
+	os << "driver " << driver << "\nparams " << params << "\nrange " << lo << " " << hi
+	   << "\nshards " << shards << "\nfirst " << first << "\nlast " << last << "\nnext " << next << "\n";
+	for( const auto& kv : results ) os << "result " << kv.first << " " << kv.second << "\n";
+	os.flush();
+	if( !os ) return false;
+      }
+      return std::rename( tmp.c_str(), path.c_str() ) == 0;
+    }
+
+    static std::optional<Checkpoint> read( const std::string& path ) {
+      std::ifstream is( path );
+      if( !is ) return std::nullopt;
+      Checkpoint retval;
+      std::string line;
+      bool have_next = false;
+      while( std::getline( is, line ) ) {
+	std::istringstream ls( line );
+	std::string key;
+	ls >> key;
+	if( key == "driver" ) ls >> retval.driver;
+	else if( key == "params" ) { std::getline( ls >> std::ws, retval.params ); }
+	else if( key == "range" ) ls >> retval.lo >> retval.hi;
+	else if( key == "shards" ) ls >> retval.shards;
+	else if( key == "first" ) ls >> retval.first;
+	else if( key == "last" ) ls >> retval.last;
+	else if( key == "next" ) { ls >> retval.next; have_next = true; }
+	else if( key == "result" ) { std::string name, v; ls >> name >> v; retval.results[name] = v; }
+      }
+      if( retval.driver.empty() || !have_next ) return std::nullopt;
+      return retval;
+    }
+  private:
+    const std::string& value( const std::string& key ) const {
+      auto it = results.find( key );
+      assert( it != results.end() && "Missing checkpoint result." );
+      return it->second;
+    }
+    std::map<std::string, std::string> results;
+  };
+
+  // Command line options shared by the drivers; parse() consumes the ones it
+  // knows from argv[first..] and leaves the rest to the driver.
+  struct Options {
+    Shard shard;
+    std::string checkpoint;          // empty: no checkpoint file
+    double interval = 60;            // seconds between checkpoint writes
+    std::vector<std::string> merge;  // -merge: checkpoint files to fold
+
+    bool parse( int argc, char* argv[], int first, std::vector<std::string>& rest ) {
+      for( int i=first; i < argc; ++i ) {
+	const std::string arg = argv[i];
+	if( arg == "-merge" ) {
+	  for( ++i; i < argc; ++i ) merge.push_back( argv[i] );
+	  return !merge.empty();
+	}
+	if( i+1 >= argc && ( arg == "-shard" || arg == "-checkpoint" || arg == "-interval" ) ) return false;
+	if( arg == "-shard" ) {
+	  const std::string s = argv[++i];
+	  const size_t slash = s.find( '/' );
+	  if( slash == std::string::npos ) return false;
+	  shard.index = std::stoul( s.substr( 0, slash ) );
+	  shard.count = std::stoul( s.substr( slash+1 ) );
+	  if( shard.count == 0 || shard.index >= shard.count ) return false;
+	}
+	else if( arg == "-checkpoint" ) checkpoint = argv[++i];
+	else if( arg == "-interval" ) interval = std::atof( argv[++i] );
+	else rest.push_back( arg );
+      }
+      return true;
+    }
+  };
+
+  // Resume point for this process's slice of the run [lo,hi): the checkpoint
+  // file if it belongs to this driver, parameters, range and slice, otherwise
+  // a fresh start. A file from some other run is never overwritten.
+  inline Checkpoint resume( const Options& options, const std::string& driver, const std::string& params,
+			    uint64_t lo, uint64_t hi ) {
+    const auto slice = options.shard.slice( lo, hi );
+    const uint64_t first = slice.first, last = slice.second;
+    Checkpoint fresh;
+    fresh.driver = driver;
+    fresh.params = params;
+    fresh.lo = lo;
+    fresh.hi = hi;
+    fresh.shards = options.shard.count;
+    fresh.first = first;
+    fresh.last = last;
+    fresh.next = first;
+    if( options.checkpoint.empty() ) return fresh;
+    std::optional<Checkpoint> saved = Checkpoint::read( options.checkpoint );
+    if( !saved ) return fresh;
+    if( saved->driver != driver || saved->params != params || saved->lo != lo || saved->hi != hi ||
+	saved->shards != fresh.shards || saved->first != first || saved->last != last ) {
+      std::cerr << options.checkpoint << " belongs to another run (" << saved->driver << " " << saved->params
+		<< " [" << saved->first << "," << saved->last << ")); refusing to overwrite it." << std::endl;
+      exit( EXIT_FAILURE );
+    }
+    std::cout << "Resuming from " << options.checkpoint << " at " << saved->next << " of ["
+	      << first << "," << last << ")" << std::endl;
+    return *saved;
+  }
+
+  // Rate limits checkpoint writes to one per interval.
+  class Writer {
+  public:
+    explicit Writer( const Options& Opts ): options{Opts}, last_write{ std::chrono::steady_clock::now() } {}
+    void maybe_write( const Checkpoint& cp ) {
+      if( options.checkpoint.empty() ) return;
+      const auto now = std::chrono::steady_clock::now();
+      if( std::chrono::duration<double>( now-last_write ).count() < options.interval ) return;
+      write( cp );
+      last_write = now;
+    }
+    void write( const Checkpoint& cp ) {
+      if( options.checkpoint.empty() ) return;
+      if( !cp.write( options.checkpoint ) ) std::cerr << "Could not write checkpoint " << options.checkpoint << std::endl;
+    }
+  private:
+    const Options& options;
+    std::chrono::steady_clock::time_point last_write;
+  };
+
+  // Read the checkpoints of a sharded run and check they cover its [lo,hi)
+  // exactly once, one per shard, with every shard finished; problems are
+  // reported on log and clear complete. Returns the checkpoints sorted by
+  // slice, or nothing if they cannot be merged at all (unreadable, or from
+  // different runs).
+  inline std::optional< std::vector<Checkpoint> > read_shards( const std::vector<std::string>& paths,
+							      const std::string& driver, std::ostream& log,
+							      bool& complete ) {
+    std::vector<Checkpoint> retval;
+    for( const auto& p : paths ) {
+      std::optional<Checkpoint> cp = Checkpoint::read( p );
+      if( !cp ) { log << "Cannot read checkpoint " << p << std::endl; return std::nullopt; }
+      if( cp->driver != driver || ( !retval.empty() && ( cp->params != retval.front().params || cp->lo != retval.front().lo ||
+							 cp->hi != retval.front().hi || cp->shards != retval.front().shards ) ) ) {
+	log << p << " is not from the same " << driver << " run." << std::endl;
+	return std::nullopt;
+      }
+      retval.push_back( *cp );
+    }
+    std::sort( retval.begin(), retval.end(), []( const Checkpoint& a, const Checkpoint& b ) { return a.first < b.first; } );
+    complete = true;
+    const Checkpoint& front = retval.front();
+    if( retval.size() != front.shards ) {
+      log << retval.size() << " checkpoints for a run of " << front.shards << " shards" << std::endl;
+      complete = false;
+    }
+    if( front.first != front.lo ) {
+      log << "Gap between " << front.lo << " and " << front.first << std::endl;
+      complete = false;
+    }
+    if( retval.back().last != front.hi ) {
+      log << "Gap between " << retval.back().last << " and " << front.hi << std::endl;
+      complete = false;
+    }
+    for( size_t i=0; i < retval.size(); ++i ) {
+      const Checkpoint& cp = retval[i];
+      if( !cp.complete() ) {
+	log << "Shard [" << cp.first << "," << cp.last << ") is done up to " << cp.next << std::endl;
+	complete = false;
+      }
+      if( i > 0 && retval[i-1].last != cp.first ) {
+	log << ( retval[i-1].last < cp.first ? "Gap" : "Overlap" ) << " between " << retval[i-1].last
+	    << " and " << cp.first << std::endl;
+	complete = false;
+      }
+    }
+    return retval;
+  }
+
+} // end of namespace CHECKPOINT
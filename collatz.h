@@ -0,0 +1,104 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : collatz.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Collatz trajectory length, shared by the thread pool drivers
+//        : collatz_count() stays in native integers and falls back to GMP
+//        : only for trajectories that outgrow 128 bits.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <cassert>
+#include <iostream>
+#include <functional>
+#include <cstdint>
+#include <gmpxx.h>
+
+#pragma once
+
+// Reference version: every step on mpz_class.
+inline int collatz_count_gmp( mpz_class GN, int retval = 1 ) {
+  assert( GN > 0 );
+  while( GN != 1 ) {
+    if( mpz_even_p( GN.get_mpz_t() ) ) GN >>= 1;
+    else GN = 3*GN+1;
+    retval++;
+  }
+  return retval;
+}
+
+// mpz_class of an unsigned integer of any width, built from 32 bit words so
+// it does not depend on the width of long (32 bits on LLP64 and 32 bit
+// targets).
+template <typename U>
+inline mpz_class collatz_mpz( U v ) {
+  constexpr size_t WORDS = ( sizeof( U )+3 )/4;
+  uint32_t words[WORDS];
+  for( size_t i=0; i < WORDS; ++i ) {
+    words[i] = static_cast<uint32_t>( v );
+    v = ( sizeof( U ) > 4 ) ? ( v >> 16 ) >> 16 : 0;
+  }
+  mpz_class retval;
+  mpz_import( retval.get_mpz_t(), WORDS, -1, sizeof( uint32_t ), 0, 0, words );
+  return retval;
+}
+
+#ifdef __SIZEOF_INT128__
+// 128 bit stage: retval terms counted up to and including W. Only a value
+// above (2^128-2)/3 moves the trajectory on to GMP.
+inline int collatz_count_u128( unsigned __int128 W, int retval = 1 ) {
+  using u128 = unsigned __int128;
+  assert( W > 0 );
+  auto ctz = []( u128 w ) {
+    const unsigned long long lo = static_cast<unsigned long long>( w );
+    return lo ? __builtin_ctzll( lo ) : 64+__builtin_ctzll( static_cast<unsigned long long>( w >> 64 ) );
+  };
+  constexpr u128 MAX128 = ( ~u128(0)-1 )/3;
+  const int tz = ctz( W );
+  u128 w = W >> tz;
+  retval += tz;
+  while( w != 1 && w <= MAX128 ) {
+    w = 3*w+1;
+    const int z = ctz( w );
+    w >>= z;
+    retval += 1+z;
+  }
+  if( w == 1 ) return retval;
+  return collatz_count_gmp( collatz_mpz( w ), retval );
+}
+#endif
+
+// Native fast path. Runs of halvings are taken in one shift by the count of
+// trailing zeros, and an odd step 3n+1 is fused with the halvings that follow
+// it. The trajectory is carried in 64 bits while 3n+1 cannot overflow, then
+// in unsigned __int128 (collatz_count_u128), and only a value above
+// (2^128-2)/3 moves it on to GMP.
+// Counts match collatz_count_gmp: number of terms including N and 1.
+inline int collatz_count( unsigned long long N ) {
+  assert( N > 0 );
+  int retval = 1;
+  const int tz = __builtin_ctzll( N );
+  unsigned long long n = N >> tz;
+  retval += tz;
+  constexpr unsigned long long MAX64 = ( ~0ull-1 )/3;
+  while( n != 1 && n <= MAX64 ) {
+    n = 3*n+1;
+    const int z = __builtin_ctzll( n );
+    n >>= z;
+    retval += 1+z;
+  }
+  if( n == 1 ) return retval;
+#ifdef __SIZEOF_INT128__
+  return collatz_count_u128( n, retval );
+#else
+  return collatz_count_gmp( collatz_mpz( n ), retval );
+#endif
+}
+
+struct CollatzOperator
+{
+  unsigned int NUM;
+  unsigned int count;
+  explicit CollatzOperator(unsigned int i=1): NUM{i}, count{0} {}
+  void operator()() { count = collatz_count( NUM ); }
+  std::function<void()> getLambda() { return [this]()->void { this->operator()(); }; }
+  //~CollatzOperator() { std::cout << __FUNCTION__ << std::endl; }
+};
@@ -0,0 +1,172 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : collatz_range.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Range search for the longest Collatz trajectory on ThreadPool
+//
+// CollatzRangeEngine finds the start value in [first,last) with the most
+// terms (ties go to the smaller start, as in test_threadpool) using
+//
+//  - a memo of term counts for every n below the cache size (16 bit each),
+//    filled once: n is followed down until it drops below itself;
+//  - a k-step jump table over the 2^k residues b of n = 2^k a + b. With the
+//    shortcut map T(n) = n/2 or (3n+1)/2, T^k(n) = 3^c[b] a + d[b], c[b] the
+//    odd steps taken, so one multiply-add replaces k steps (k+c[b] terms);
+//  - residue sieving: a start that cannot beat a smaller one in the same
+//    block is not evaluated. n = 6j+4 is reached from (n-1)/3 in one step,
+//    and residues b' > b with equal c and d merge with 2^k a + b after k
+//    steps, so they have exactly as many terms as the smaller start.
+//
+// search() cuts the range into blocks and runs them on the pool a wave at a
+// time; each block maximum is handed to a callback in range order, so the
+// memory held is the tables plus one wave of results, independent of the
+// size of the range.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "collatz.h"
+#include "parallel_algorithms.h"
+#include <vector>
+#include <cstdint>
+
+#pragma once
+
+struct CollatzRecord
+{
+  unsigned long long NUM;
+  unsigned int count;
+};
+
+// More terms wins, ties go to the smaller start.
+inline CollatzRecord collatz_better( const CollatzRecord& a, const CollatzRecord& b ) {
+  if( a.count != b.count ) return ( a.count > b.count ) ? a : b;
+  return ( a.NUM < b.NUM ) ? a : b;
+}
+
+class CollatzRangeEngine
+{
+public:
+  // K jump bits (2^K table entries), memo for n < CacheSize (at least 2^(K+1)).
+  explicit CollatzRangeEngine( unsigned int K = 16, size_t CacheSize = size_t(1) << 22 ):
+    K_BITS{K}, CACHE_SIZE{ std::max( CacheSize, size_t(1) << (K+1) ) } {
+    assert( K >= 1 && K <= 20 ); // d[b] < 3^20 fits 32 bits
+    build_jump_table();
+    build_memo();
+  }
+
+  unsigned int jump_bits() const { return K_BITS; }
+  size_t cache_size() const { return CACHE_SIZE; }
+
+  // Terms in the trajectory of n (collatz_count(n)).
+  unsigned int count( unsigned long long n ) const {
+    assert( n > 0 );
+    unsigned int terms = 0;
+    while( n >= CACHE_SIZE ) {
+      const unsigned long long a = n >> K_BITS;
+      if( a > JUMP_LIMIT ) return terms + collatz_count( n );
+      const uint32_t b = static_cast<uint32_t>( n & MASK );
+      const unsigned int c = odd_steps[b];
+      n = power3[c]*a + jump_offset[b];
+      terms += K_BITS+c;
+    }
+    return terms + memo[n];
+  }
+
+  // Starts in [lo,hi) the sieve proves cannot be the block maximum are skipped.
+  CollatzRecord search_block( unsigned long long lo, unsigned long long hi ) const {
+    CollatzRecord retval{ lo, 0 };
+    const unsigned long long floor = std::max<unsigned long long>( lo, 2ull << K_BITS );
+    for( unsigned long long n=lo; n < hi; ++n ) {
+      if( n % 6 == 4 && (n-1)/3 >= lo ) continue;
+      const uint32_t merge = merges_with[n & MASK];
+      if( merge && n >= floor+merge ) continue;
+      const unsigned int terms = count( n );
+      if( terms > retval.count ) retval = CollatzRecord{ n, terms };
+    }
+    return retval;
+  }
+
+  // OnBlock( lo, hi, block_max ) is called for every block, in range order,
+  // from the calling thread.
+  template <typename ON_BLOCK>
+  CollatzRecord search( THREAD_POOL::ThreadPool& pool, unsigned long long first, unsigned long long last,
+			unsigned long long block, ON_BLOCK on_block ) const {
+    assert( block > 0 );
+    CollatzRecord retval{ first, 0 };
+    const size_t WAVE = 8*pool.max_threads();
+    std::vector<CollatzRecord> results( WAVE );
+    while( first < last ) {
+      const unsigned long long blocks = std::min<unsigned long long>( WAVE, (last-first+block-1)/block );
+      THREAD_POOL::parallel_for( pool, size_t(0), size_t(blocks), [&]( size_t i ) {
+	  const unsigned long long lo = first + i*block;
+	  results[i] = search_block( lo, std::min( lo+block, last ) );
+	}, size_t(1) );
+      for( size_t i=0; i < blocks; ++i ) {
+	const unsigned long long lo = first + i*block;
+	on_block( lo, std::min( lo+block, last ), results[i] );
+	if( results[i].count ) retval = collatz_better( retval, results[i] );
+      }
+      first = std::min( last, first + blocks*block );
+    }
+    return retval;
+  }
+  CollatzRecord search( THREAD_POOL::ThreadPool& pool, unsigned long long first, unsigned long long last,
+			unsigned long long block = 1ull << 20 ) const {
+    return search( pool, first, last, block, []( unsigned long long, unsigned long long, const CollatzRecord& ) {} );
+  }
+
+private:
+  void build_jump_table() {
+    const size_t ENTRIES = size_t(1) << K_BITS;
+    odd_steps.resize( ENTRIES );
+    jump_offset.resize( ENTRIES );
+    merges_with.assign( ENTRIES, 0 );
+    for( size_t b=0; b < ENTRIES; ++b ) {
+      unsigned long long x = b;
+      unsigned int c = 0;
+      for( unsigned int j=0; j < K_BITS; ++j ) {
+	if( x & 1 ) { x = (3*x+1)/2; ++c; }
+	else x /= 2;
+      }
+      odd_steps[b] = static_cast<uint8_t>( c );
+      jump_offset[b] = static_cast<uint32_t>( x );
+    }
+    for( unsigned int c=0; c <= K_BITS; ++c ) power3[c] = c ? 3*power3[c-1] : 1;
+    JUMP_LIMIT = ( ~0ull - power3[K_BITS] )/power3[K_BITS];
+    // Residues with the same (c,d) as a smaller one; keep the distance back.
+    std::vector<uint32_t> order( ENTRIES );
+    for( size_t b=0; b < ENTRIES; ++b ) order[b] = static_cast<uint32_t>( b );
+    std::stable_sort( order.begin(), order.end(), [this]( uint32_t x, uint32_t y ) {
+	if( odd_steps[x] != odd_steps[y] ) return odd_steps[x] < odd_steps[y];
+	return jump_offset[x] < jump_offset[y];
+      } );
+    for( size_t i=1; i < ENTRIES; ++i ) {
+      const uint32_t prev = order[i-1], cur = order[i];
+      if( odd_steps[prev] == odd_steps[cur] && jump_offset[prev] == jump_offset[cur] )
+	merges_with[cur] = cur - prev; // stable sort: prev < cur
+    }
+  }
+
+  void build_memo() {
+    memo.assign( CACHE_SIZE, 0 );
+    if( CACHE_SIZE > 1 ) memo[1] = 1;
+    for( unsigned long long n=2; n < CACHE_SIZE; ++n ) {
+      unsigned long long x = n;
+      unsigned int steps = 0;
+      while( x >= n ) {
+	x = ( x & 1 ) ? 3*x+1 : x/2;
+	++steps;
+      }
+      assert( steps + memo[x] <= UINT16_MAX );
+      memo[n] = static_cast<uint16_t>( steps + memo[x] );
+    }
+  }
+
+  const unsigned int K_BITS;
+  const size_t CACHE_SIZE;
+  const unsigned long long MASK = ( 1ull << K_BITS ) - 1;
+  unsigned long long JUMP_LIMIT = 0; // largest a = n >> K that cannot overflow
+  unsigned long long power3[21];
+  std::vector<uint8_t> odd_steps;
+  std::vector<uint32_t> jump_offset;
+  std::vector<uint32_t> merges_with; // 0, or b - b' for a smaller b' merging with b
+  std::vector<uint16_t> memo;
+};
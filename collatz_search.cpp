@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : collatz_search.cpp
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Longest Collatz trajectory over [FIRST,LAST) with CollatzRangeEngine.
+//        : Block maxima stream in range order; every new record is printed
+//        : as it is found, so ranges of 10^10 and beyond run in bounded memory.
+//        : -shard/-checkpoint/-merge split a run over processes and restarts
+//        : (checkpoint.h).
+// g++ -O2 -Wall -std=c++17 collatz_search.cpp -o collatz_search -pthread -lgmpxx -lgmp
+////////////////////////////////////////////////////////////////////////////////
+
+#include "collatz_range.h"
+#include "checkpoint.h"
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+
+using namespace THREAD_POOL;
+
+// Fold the checkpoints of all shards of one run.
+static int MergeShards( const std::vector<std::string>& paths )
+{
+  bool complete = false;
+  auto shards = CHECKPOINT::read_shards( paths, "collatz", std::cerr, complete );
+  if( !shards ) return EXIT_FAILURE;
+  CollatzRecord best{ shards->front().first, 0 };
+  unsigned long long done = 0;
+  for( const auto& cp : *shards ) {
+    if( cp.has( "best_count" ) )
+      best = collatz_better( best, CollatzRecord{ cp.get_u64( "best_num" ), static_cast<unsigned int>( cp.get_u64( "best_count" ) ) } );
+    done += cp.next-cp.first;
+  }
+  std::cout << shards->front().params << ( complete ? "" : " (INCOMPLETE)" ) << "\n";
+  std::cout << "MAX COLLATZ = " << best.NUM << "\t" << best.count << "\t(" << done << " starts)" << std::endl;
+  return complete ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void Usage( const char* progName )
+{
+  std::cout << progName << " T (threads) FIRST LAST [BLOCK] [-shard i/S] [-checkpoint FILE] [-interval SECONDS]\n"
+	    << progName << " -merge CHECKPOINT..." << std::endl;
+  exit(-1);
+}
+int main(int argc, char* argv[])
+{
+  CHECKPOINT::Options options;
+  std::vector<std::string> args;
+  if( !options.parse( argc, argv, 1, args ) ) Usage( argv[0] );
+  if( !options.merge.empty() ) return MergeShards( options.merge );
+  if( args.size() != 3 && args.size() != 4 ) Usage( argv[0] );
+  const unsigned int T = atoi( args[0].c_str() );
+  const unsigned long long FIRST = strtoull( args[1].c_str(), nullptr, 10 );
+  const unsigned long long LAST = strtoull( args[2].c_str(), nullptr, 10 );
+  const unsigned long long BLOCK = ( args.size() == 4 ) ? strtoull( args[3].c_str(), nullptr, 10 ) : 1ull << 20;
+  if( T == 0 || FIRST == 0 || LAST <= FIRST || BLOCK == 0 ) Usage( argv[0] );
+
+  // Block maxima arrive in range order, so [first,next) is always finished.
+  const std::string params = "first=" + std::to_string( FIRST ) + " last=" + std::to_string( LAST );
+  CHECKPOINT::Checkpoint cp = CHECKPOINT::resume( options, "collatz", params, FIRST, LAST );
+  CollatzRecord best{ cp.first, 0 };
+  if( cp.has( "best_count" ) ) best = CollatzRecord{ cp.get_u64( "best_num" ), static_cast<unsigned int>( cp.get_u64( "best_count" ) ) };
+  CHECKPOINT::Writer writer( options );
+
+  auto start = std::chrono::steady_clock::now();
+  const CollatzRangeEngine engine;
+  ThreadPool pool{T, SCHEDULING::WORK_STEALING};
+  pool.start();
+  const unsigned long long resumed = cp.next;
+  if( !cp.complete() ) {
+    engine.search( pool, cp.next, cp.last, BLOCK,
+      [&]( unsigned long long lo, unsigned long long hi, const CollatzRecord& r ) {
+	if( r.count > best.count ) {
+	  best = r;
+	  std::cout << "[" << lo << "," << hi << ")\t" << r.NUM << "\t" << r.count << std::endl;
+	}
+	cp.next = hi;
+	cp.set( "best_num", uint64_t( best.NUM ) );
+	cp.set( "best_count", uint64_t( best.count ) );
+	writer.maybe_write( cp );
+      } );
+  }
+  writer.write( cp );
+  const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now()-start ).count();
+  std::cout << "MAX COLLATZ = " << best.NUM << "\t" << best.count
+	    << "\t(" << seconds << " s, " << (cp.last-resumed)/seconds << " starts/s)" << std::endl;
+  return (0);
+}
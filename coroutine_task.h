@@ -0,0 +1,219 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : coroutine_task.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: C++20 coroutines on THREAD_POOL::ThreadPool
+//
+// task<T> is a lazy coroutine: nothing runs until it is co_awaited (or handed
+// to sync_wait), and the awaiting coroutine becomes its continuation.
+// Awaiting resumes the child from await_suspend; a flag in the promise,
+// set by whichever of the two gets there second, decides who carries on.
+// A child that finished inside that resume() makes await_suspend return
+// false, so the awaiting coroutine continues in its own frame; one that
+// suspended (say on schedule_on) resumes the awaiting coroutine from its
+// final_suspend later. A long run of awaits on tasks that finish
+// synchronously therefore needs no tail calls and keeps the stack flat at
+// any optimisation level.
+//
+//   co_await schedule_on( pool );   // resume as a task of pool
+//
+// moves the rest of the coroutine onto the pool; nothing blocks a worker
+// while it waits. sync_wait() is the bridge back from ordinary code: it
+// starts the task on the calling thread and helps the pool (help_while)
+// until it is done, then returns the value or rethrows.
+// Needs -std=c++20.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "threadpool.h"
+#include <atomic>
+#include <coroutine>
+#include <utility>
+
+#pragma once
+
+#ifndef __cpp_impl_coroutine
+#error "coroutine_task.h needs compiler support for C++20 coroutines (-std=c++20)"
+#endif
+
+namespace THREAD_POOL {
+
+  template <typename T = void> class task;
+
+  // Resumes whoever awaited the finished task if it has already suspended;
+  // otherwise it is still inside its resume() of this task and carries on
+  // from there.
+  struct TaskFinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<> await_suspend( std::coroutine_handle<P> h ) const noexcept {
+      auto& promise = h.promise();
+      if( promise.ready.exchange( true, std::memory_order_acq_rel ) && promise.continuation )
+	return promise.continuation;
+      return std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+  };
+
+  struct TaskPromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+    std::atomic<bool> ready{false}; // raised by the awaiter and by final_suspend
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    TaskFinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+    void rethrow() const { if( exception ) std::rethrow_exception( exception ); }
+  };
+
+  template <typename T>
+  struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+    task<T> get_return_object();
+    template <typename U>
+    void return_value( U&& v ) { value.emplace( std::forward<U>( v ) ); }
+    T result() { rethrow(); return std::move( *value ); }
+  };
+
+  template <>
+  struct TaskPromise<void> : TaskPromiseBase {
+    task<void> get_return_object();
+    void return_void() const {}
+    void result() const { rethrow(); }
+  };
+
+  template <typename T>
+  class task {
+  public:
+    using promise_type = TaskPromise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    task() = default;
+    explicit task( handle_type h ): handle{h} {}
+    task( task&& other ) noexcept : handle{ std::exchange( other.handle, nullptr ) } {}
+    task& operator=( task&& other ) noexcept {
+      if( this != &other ) {
+	if( handle ) handle.destroy();
+	handle = std::exchange( other.handle, nullptr );
+      }
+      return *this;
+    }
+    task( const task& ) = delete;
+    task& operator=( const task& ) = delete;
+    ~task() { if( handle ) handle.destroy(); }
+
+    bool valid() const { return static_cast<bool>( handle ); }
+    bool done() const { return handle && handle.done(); }
+
+    // co_await starts the task and hands over to it; its result (or
+    // exception) comes back when it finishes.
+    auto operator co_await() & noexcept { return Awaiter{handle}; }
+    auto operator co_await() && noexcept { return Awaiter{handle}; }
+
+    // As co_await, but yields nothing and leaves the result in place.
+    auto when_ready() noexcept { return ReadyAwaiter{handle}; }
+    // Value or exception of a finished task.
+    T result() { assert( done() ); return handle.promise().result(); }
+  private:
+    struct ReadyAwaiter {
+      handle_type h;
+      bool await_ready() const noexcept { return !h || h.done(); }
+      // Runs h until it finishes or suspends. Nothing of *this (in the
+      // awaiting frame) or of h is touched after the exchange: the other
+      // side may resume the awaiting coroutine at once.
+      bool await_suspend( std::coroutine_handle<> awaiting ) const noexcept {
+	auto& promise = h.promise();
+	promise.continuation = awaiting;
+	h.resume();
+	return !promise.ready.exchange( true, std::memory_order_acq_rel );
+      }
+      void await_resume() const noexcept {}
+    };
+    struct Awaiter : ReadyAwaiter {
+      T await_resume() const {
+	assert( this->h && "co_await on an empty task." );
+	return this->h.promise().result();
+      }
+    };
+
+    handle_type handle;
+  };
+
+  template <typename T>
+  task<T> TaskPromise<T>::get_return_object() {
+    return task<T>{ std::coroutine_handle< TaskPromise<T> >::from_promise( *this ) };
+  }
+  inline task<void> TaskPromise<void>::get_return_object() {
+    return task<void>{ std::coroutine_handle< TaskPromise<void> >::from_promise( *this ) };
+  }
+
+  // co_await schedule_on( pool ) suspends and resumes on one of pool's workers.
+  class ScheduleAwaiter {
+  public:
+    ScheduleAwaiter( ThreadPool& Pool, PRIORITY Priority ): pool{Pool}, priority{Priority} {}
+    bool await_ready() const noexcept { return false; }
+    void await_suspend( std::coroutine_handle<> h ) const {
+      pool.add( [h]() { h.resume(); }, priority );
+    }
+    void await_resume() const noexcept {}
+  private:
+    ThreadPool& pool;
+    PRIORITY priority;
+  };
+
+  inline ScheduleAwaiter schedule_on( ThreadPool& pool, PRIORITY priority = PRIORITY::NORMAL ) {
+    return ScheduleAwaiter{ pool, priority };
+  }
+
+  // Coroutine used by sync_wait: awaits the task, then raises done as the
+  // very last touch of its frame, after which the waiter may destroy it.
+  class SyncWaitDriver {
+  public:
+    struct promise_type {
+      std::atomic<bool>* done = nullptr;
+      SyncWaitDriver get_return_object() {
+	return SyncWaitDriver{ std::coroutine_handle<promise_type>::from_promise( *this ) };
+      }
+      std::suspend_always initial_suspend() const noexcept { return {}; }
+      auto final_suspend() const noexcept {
+	struct Signal {
+	  bool await_ready() const noexcept { return false; }
+	  void await_suspend( std::coroutine_handle<promise_type> h ) const noexcept {
+	    h.promise().done->store( true, std::memory_order_release );
+	  }
+	  void await_resume() const noexcept {}
+	};
+	return Signal{};
+      }
+      void return_void() const {}
+      void unhandled_exception() const { std::terminate(); }
+    };
+
+    explicit SyncWaitDriver( std::coroutine_handle<promise_type> h ): handle{h} {}
+    SyncWaitDriver( const SyncWaitDriver& ) = delete;
+    SyncWaitDriver& operator=( const SyncWaitDriver& ) = delete;
+    ~SyncWaitDriver() { handle.destroy(); }
+
+    void start( std::atomic<bool>& done ) {
+      handle.promise().done = &done;
+      handle.resume();
+    }
+  private:
+    std::coroutine_handle<promise_type> handle;
+  };
+
+  template <typename T>
+  SyncWaitDriver sync_wait_driver( task<T>& t ) {
+    co_await t.when_ready();
+  }
+
+  // Run t to completion from ordinary code. The calling thread runs queued
+  // pool tasks while it waits, so this is safe on a worker as well.
+  template <typename T>
+  T sync_wait( ThreadPool& pool, task<T> t ) {
+    std::atomic<bool> done{false};
+    SyncWaitDriver driver = sync_wait_driver( t );
+    driver.start( done );
+    pool.help_while( [&done]() { return !done.load( std::memory_order_acquire ); } );
+    return t.result();
+  }
+
+} // end of namespace THREAD_POOL
@@ -0,0 +1,154 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : cpu_topology.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: NUMA node / CPU discovery and thread pinning for ThreadPool
+//
+// On Linux the nodes come from /sys/devices/system/node/node*/cpulist,
+// restricted to the CPUs this process may run on (sched_getaffinity, so
+// taskset/cgroup limits are honoured). Elsewhere, or when /sys is missing,
+// everything is one node of hardware_concurrency() CPUs and pinning is a
+// no-op.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+#include <cctype>
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#endif
+
+#pragma once
+
+namespace THREAD_POOL {
+
+  // CPUs the calling thread may run on; empty if unknown.
+  inline std::vector<unsigned int> current_affinity()
+  {
+    std::vector<unsigned int> retval;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    if( pthread_getaffinity_np( pthread_self(), sizeof(set), &set ) != 0 ) return retval;
+    for( unsigned int c=0; c < CPU_SETSIZE; ++c ) if( CPU_ISSET( c, &set ) ) retval.push_back( c );
+#endif
+    return retval;
+  }
+
+  // Restrict the calling thread to cpus; false if unsupported or refused.
+  inline bool set_affinity( const std::vector<unsigned int>& cpus )
+  {
+#ifdef __linux__
+    if( cpus.empty() ) return false;
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    for( unsigned int c : cpus ) if( c < CPU_SETSIZE ) CPU_SET( c, &set );
+    return pthread_setaffinity_np( pthread_self(), sizeof(set), &set ) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+  }
+
+  // CPU the calling thread is running on right now (0 if unknown).
+  inline unsigned int current_cpu()
+  {
+#ifdef __linux__
+    const int cpu = sched_getcpu();
+    return ( cpu < 0 ) ? 0 : static_cast<unsigned int>( cpu );
+#else
+    return 0;
+#endif
+  }
+
+  class CpuTopology {
+  public:
+    // Parse "0-3,8,10-11" style lists as found in sysfs.
+    static std::vector<unsigned int> parse_cpulist( const std::string& list ) {
+      std::vector<unsigned int> retval;
+      std::stringstream stream( list );
+      std::string range;
+      while( std::getline( stream, range, ',' ) ) {
+	if( range.empty() || range == "\n" ) continue;
+	const size_t dash = range.find( '-' );
+	const unsigned int lo = std::stoul( range.substr( 0, dash ) );
+	const unsigned int hi = ( dash == std::string::npos ) ? lo : std::stoul( range.substr( dash+1 ) );
+	for( unsigned int c=lo; c <= hi; ++c ) retval.push_back( c );
+      }
+      return retval;
+    }
+
+    static CpuTopology discover() {
+      CpuTopology retval;
+      std::vector<unsigned int> allowed = current_affinity();
+      if( allowed.empty() ) {
+	for( unsigned int c=0; c < std::max( 1u, std::thread::hardware_concurrency() ); ++c ) allowed.push_back( c );
+      }
+#ifdef __linux__
+      std::vector<unsigned int> node_ids;
+      if( DIR* dir = opendir( "/sys/devices/system/node" ) ) {
+	while( dirent* entry = readdir( dir ) ) {
+	  const std::string name = entry->d_name;
+	  if( name.size() > 4 && name.compare( 0, 4, "node" ) == 0 &&
+	      std::all_of( name.begin()+4, name.end(), ::isdigit ) )
+	    node_ids.push_back( std::stoul( name.substr( 4 ) ) );
+	}
+	closedir( dir );
+      }
+      std::sort( node_ids.begin(), node_ids.end() );
+      for( unsigned int id : node_ids ) {
+	std::ifstream file( "/sys/devices/system/node/node" + std::to_string( id ) + "/cpulist" );
+	std::string list;
+	if( !std::getline( file, list ) ) continue;
+	std::vector<unsigned int> cpus;
+	for( unsigned int c : parse_cpulist( list ) )
+	  if( std::binary_search( allowed.begin(), allowed.end(), c ) ) cpus.push_back( c );
+	if( !cpus.empty() ) retval.nodes.push_back( cpus );
+      }
+#endif
+      if( retval.nodes.empty() ) retval.nodes.push_back( allowed );
+      retval.index_cpus();
+      return retval;
+    }
+
+    // No discovery: one node of hardware_concurrency() CPUs.
+    static CpuTopology single_node() {
+      CpuTopology retval;
+      retval.nodes.emplace_back();
+      for( unsigned int c=0; c < std::max( 1u, std::thread::hardware_concurrency() ); ++c ) retval.nodes[0].push_back( c );
+      retval.index_cpus();
+      return retval;
+    }
+
+    size_t node_count() const { return nodes.size(); }
+    const std::vector<unsigned int>& node_cpus( size_t node ) const { return nodes[node]; }
+    // All usable CPUs, node by node.
+    std::vector<unsigned int> cpus() const {
+      std::vector<unsigned int> retval;
+      for( const auto& n : nodes ) retval.insert( retval.end(), n.begin(), n.end() );
+      return retval;
+    }
+    size_t node_of( unsigned int cpu ) const {
+      return ( cpu < cpu_node.size() ) ? cpu_node[cpu] : 0;
+    }
+  private:
+    void index_cpus() {
+      for( size_t i=0; i < nodes.size(); ++i ) {
+	for( unsigned int c : nodes[i] ) {
+	  if( c >= cpu_node.size() ) cpu_node.resize( c+1, 0 );
+	  cpu_node[c] = static_cast<unsigned int>( i );
+	}
+      }
+    }
+
+    std::vector< std::vector<unsigned int> > nodes;
+    std::vector<unsigned int> cpu_node; // node index by CPU number
+  };
+
+} // end of namespace THREAD_POOL
@@ -6,12 +6,22 @@
 //
 // (1) Compiled on Visual Studio also
 // (2) getting ready for CoPilot and VSCode
+// (3) -shard/-checkpoint/-merge split long runs over processes and restarts
+//     (checkpoint.h); polynomial i is seeded from (SEED,i).
+// (4) BatchMCI vectorizes; build with
+// g++ -O3 -march=native -std=c++17 -fopenmp monte_carlo_integration.cpp -o monte_carlo_integration
+// (5) -tol REL stops each integral once its 95% interval is within REL
+//     relative error (N is then the cap); samples used are reported.
+// (6) Estimator "mean" (sample mean) or "cv" (sample mean with a cubic fit
+//     as control variate, K = 1) instead of hit or miss.
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <cassert>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <sstream>
+#include <limits>
 #include <vector>
 #include <functional>
 #include <random>
@@ -19,122 +29,183 @@
 #include <memory>
 #include <omp.h>
 #include "polynomial.h"
+#include "monte_carlo_integration.h"
+#include "checkpoint.h"
 
-namespace MonteCarloIntegration {
-  using UNIVARIATE_FUNCTION = std::function<double(double)>;
-  class MCI
-  {
-  public:
-    MCI( double A, double B, int N, const UNIVARIATE_FUNCTION& F ): m_A{A}, m_B{B}, m_N{N}, m_F{F} { SetupRNG(); }
-    double Integral() const;
-  private:
-    void SetupRNG();
-    double getRandomNumberX() const { return (*(URDP_X))(*(DREP)); }
-    double getRandomNumberY() const { return (*(URDP_Y))(*(DREP)); }
-  protected:
-    double m_A, m_B;
-    int m_N;
-    const UNIVARIATE_FUNCTION& m_F;
-    std::unique_ptr<std::mt19937> DREP;
-    std::unique_ptr<std::uniform_real_distribution<double>> URDP_X, URDP_Y;
-    double MAXIMUM_VALUE_OF_FUNCTION, MINIMUM_VALUE_OF_FUNCTION;
-  };
-};
+using namespace MonteCarloIntegration;
 
-void MonteCarloIntegration::MCI::SetupRNG()
+// Polynomial i is seeded from (SEED,i) and samples Philox stream i, so a run split into
+// shards, or stopped and resumed from its checkpoint, gives the same result.
+// With TOL > 0 sampling stops at that relative error; samples gets the count.
+static double PolynomialError( int N, uint64_t SEED, uint64_t i, ESTIMATOR E, double TOL, uint64_t& samples )
 {
-  // Assumption 1: function is monotonic, so max is either f(A) or f(B)
-  MAXIMUM_VALUE_OF_FUNCTION = std::max( m_F(m_A), m_F(m_B) );
-  MINIMUM_VALUE_OF_FUNCTION = std::min( m_F(m_A), m_F(m_B) );
-  //std::cout << "Function in : " << MINIMUM_VALUE_OF_FUNCTION << "\t" << MAXIMUM_VALUE_OF_FUNCTION << std::endl;
-  std::random_device rd;
-  std::seed_seq seed{ rd(), rd(), rd(), rd(), rd(), rd(), rd(), rd() };
-  DREP.reset(new std::mt19937( seed ));
-  URDP_X.reset(new std::uniform_real_distribution<double>(m_A,m_B));
-  URDP_Y.reset(new std::uniform_real_distribution<double>(0,MAXIMUM_VALUE_OF_FUNCTION));
+  using PX = Polynomial<double,10>; // fixed size: unrolled Horner, same coefficients as Polynomial<double>(10)
+  PX px;
+  px.RandomCoefficients( CHECKPOINT::item_seed( SEED, 2*i ) );
+  double A = 1.15;
+  double B = 2.23;
+  // Block evaluation of px over each batch of samples; same samples as MCI.
+  BatchMCI m(A,B,N,px.horner(),SEED,i); // stream i of SEED
+  Tolerance tol;
+  tol.relative = TOL;
+  const MCIResult r = m.Integral( E, tol );
+  double mc_int = r.estimate;
+  samples = r.samples;
+  double pc_int = px.Integral(A,B);
+  double error  = std::abs(pc_int-mc_int);
+  double rel    = 100.0*error/pc_int;
+#if 0
+  #pragma omp critical
+  std::cout << std::setw(8) << pc_int << "\t" << std::setw(8) << mc_int << "\t" 
+	    << std::setw(8) << error << "\t" << std::setw(8) << rel << "\t" << px << std::endl;
+#endif
+  return rel;
+}
 
-  if(false){
-    std::ofstream f("a.dat");
-    for( int i=0; i < 100; ++i ) { 
-      double x = getRandomNumberX();
-      f << x << "\t" << m_F(x) << "\t" << getRandomNumberY() << "\n";
-    }
+// Polynomials [lo,hi) of group g (K polynomials from g*K) share the samples
+// of stream g; a polynomial gets the same samples whichever part of its
+// group this shard or chunk holds.
+static std::vector<double> GroupErrors( int N, uint64_t SEED, uint64_t g, uint64_t lo, uint64_t hi, ESTIMATOR E )
+{
+  std::vector< Polynomial<double> > group( hi-lo, Polynomial<double>(10) );
+  for( uint64_t i=lo; i < hi; ++i ) group[i-lo].RandomCoefficients( CHECKPOINT::item_seed( SEED, 2*i ) );
+  double A = 1.15;
+  double B = 2.23;
+  MultiMCI m(A,B,N,group,SEED,g);
+  const std::vector<double> mc_int = m.Integrals( E );
+  std::vector<double> retval( group.size() );
+  for( size_t k=0; k < group.size(); ++k ) {
+    double pc_int = group[k].Integral(A,B);
+    retval[k] = 100.0*std::abs(pc_int-mc_int[k])/pc_int;
   }
-  #if 0
-  // Generate a normal distribution around that mean
-  std::seed_seq seed2{r(), r(), r(), r(), r(), r(), r(), r()}; 
-  std::mt19937 e2(seed2);
-  std::normal_distribution<> normal_dist(mean, 2);
-  #endif
+  return retval;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-// Originally the plan was for multiple random evals in this loop for the
-// trials. But there is lot of correlation between the RNG across multiple
-// threads. It is thus better if multiple polynomials are computed in
-// parallel. The polynomials have the same domain, so actually the X rng
-// could in theory be shared, redcuing the work, but in future we want to
-// explore multiple domains.
-//
-////////////////////////////////////////////////////////////////////////////////
-double MonteCarloIntegration::MCI::Integral() const
+static std::string RunParams( int M, int N, uint64_t SEED, uint64_t K, ESTIMATOR E, double TOL )
 {
-  double retval=0;
-  for( int i=0; i < m_N; ++i ) {
-    double x = getRandomNumberX();
-    double y = getRandomNumberY();
-    //std::cout << "Trial " << i << "\t X = " << x << "\t f(x) = " << m_F(x) << "\t Y = " << y << "\n";
-    if( y < m_F(x) ) retval++;
+  std::string retval = "M=" + std::to_string( M ) + " N=" + std::to_string( N ) + " seed=" + std::to_string( SEED );
+  if( K > 1 ) retval += " K=" + std::to_string( K );
+  if( E != ESTIMATOR::HIT_OR_MISS ) retval += ( E == ESTIMATOR::MEAN_VALUE ) ? " mean" : " cv";
+  if( TOL > 0 ) { // to_string keeps six decimals: 1e-7 would read as 0
+    std::ostringstream os;
+    os << std::setprecision( std::numeric_limits<double>::max_digits10 ) << TOL;
+    retval += " tol=" + os.str();
   }
-  return (m_B-m_A)*((MAXIMUM_VALUE_OF_FUNCTION*retval)/(double)m_N);
+  return retval;
 }
 
-using namespace MonteCarloIntegration;
-
-static void TestMonteCarlo( int M, int N )
+// Works through this shard's polynomials a chunk at a time; the checkpoint
+// holds the max and sum of the relative errors of [first,next) and the
+// samples drawn. With K > 1 groups of K polynomials share samples (MultiMCI).
+static void TestMonteCarlo( int M, int N, uint64_t SEED, uint64_t K, ESTIMATOR E, double TOL,
+			    const CHECKPOINT::Options& options )
 {
   std::cout << "Running " << __FUNCTION__ << " with N = " << N << std::endl;
-  using PX = Polynomial<double>;
-  double max_rel_error = 0;
+  CHECKPOINT::Checkpoint cp = CHECKPOINT::resume( options, "mci", RunParams( M, N, SEED, K, E, TOL ), 0, M );
+  double max_rel_error = cp.has( "max_rel_error" ) ? cp.get_double( "max_rel_error" ) : 0;
+  double sum_rel_error = cp.has( "sum_rel_error" ) ? cp.get_double( "sum_rel_error" ) : 0;
+  uint64_t samples = cp.has( "samples" ) ? cp.get_u64( "samples" ) : 0;
+  CHECKPOINT::Writer writer( options );
+  const uint64_t CHUNK = 16*omp_get_max_threads()*K;
   std::cout << std::setw(8) << "POL INT" << "\t" << std::setw(8) << "MC INT" << "\t" 
 	    << std::setw(8) << "ERROR" << "\t" << std::setw(8) << "REL %ERROR" << "\t\t" << "POLYNOMIAL" << std::endl;
   std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
-  #pragma omp parallel for reduction(max:max_rel_error)
-  for( int i=0; i < M; ++i ) {
-    PX px(10);
-    px.RandomCoefficients();
-    double A = 1.15;
-    double B = 2.23;
-    auto f{px.getHorner()}; // Visual Studio needs this outside
-    MCI m(A,B,N,f);
-    double mc_int = m.Integral();
-    double pc_int = px.Integral(A,B);
-    double error  = std::abs(pc_int-mc_int);
-    double rel    = 100.0*error/pc_int;
-    max_rel_error = std::max( max_rel_error, rel );
-#if 0
-    #pragma omp critical
-    std::cout << std::setw(8) << pc_int << "\t" << std::setw(8) << mc_int << "\t" 
-	      << std::setw(8) << error << "\t" << std::setw(8) << rel << "\t" << px << std::endl;
-#endif
+  while( !cp.complete() ) {
+    const int64_t lo = cp.next, hi = std::min( cp.last, cp.next+CHUNK );
+    if( K == 1 ) {
+      #pragma omp parallel for reduction(max:max_rel_error) reduction(+:sum_rel_error,samples)
+      for( int64_t i=lo; i < hi; ++i ) {
+	uint64_t used = 0;
+	double rel = PolynomialError( N, SEED, i, E, TOL, used );
+	max_rel_error = std::max( max_rel_error, rel );
+	sum_rel_error += rel;
+	samples += used;
+      }
+    } else {
+      const int64_t IK = K;
+      #pragma omp parallel for reduction(max:max_rel_error) reduction(+:sum_rel_error,samples)
+      for( int64_t g=lo/IK; g <= (hi-1)/IK; ++g ) {
+	const int64_t glo = std::max( lo, g*IK ), ghi = std::min( hi, (g+1)*IK );
+	for( double rel : GroupErrors( N, SEED, g, glo, ghi, E ) ) {
+	  max_rel_error = std::max( max_rel_error, rel );
+	  sum_rel_error += rel;
+	}
+	samples += uint64_t(N)*( ghi-glo );
+      }
+    }
+    cp.next = hi;
+    cp.set( "max_rel_error", max_rel_error );
+    cp.set( "sum_rel_error", sum_rel_error );
+    cp.set( "samples", samples );
+    writer.maybe_write( cp );
   }
+  writer.write( cp );
   std::cout << "------------------------------------------------------------------------------------------------" << std::endl;
-  std::cout << "MAX REL ERROR := " << max_rel_error << std::endl;
+  std::cout << "MAX REL ERROR := " << max_rel_error << "\tMEAN := " << sum_rel_error/std::max<uint64_t>( 1, cp.last-cp.first )
+	    << "\t(polynomials [" << cp.first << "," << cp.last << ") of " << M << ")" << std::endl;
+  std::cout << "SAMPLES := " << samples << "\tPER POLYNOMIAL := " << samples/std::max<uint64_t>( 1, cp.last-cp.first ) << std::endl;
+}
+
+// Fold the checkpoints of all shards of one run.
+static int MergeShards( const std::vector<std::string>& paths )
+{
+  bool complete = false;
+  auto shards = CHECKPOINT::read_shards( paths, "mci", std::cerr, complete );
+  if( !shards ) return EXIT_FAILURE;
+  double max_rel_error = 0, sum_rel_error = 0;
+  uint64_t done = 0, samples = 0;
+  for( const auto& cp : *shards ) {
+    if( cp.has( "max_rel_error" ) ) max_rel_error = std::max( max_rel_error, cp.get_double( "max_rel_error" ) );
+    if( cp.has( "sum_rel_error" ) ) sum_rel_error += cp.get_double( "sum_rel_error" );
+    if( cp.has( "samples" ) ) samples += cp.get_u64( "samples" );
+    done += cp.next-cp.first;
+  }
+  std::cout << shards->front().params << ( complete ? "" : " (INCOMPLETE)" ) << "\n";
+  std::cout << "MAX REL ERROR := " << max_rel_error << "\tMEAN := " << sum_rel_error/std::max<uint64_t>( 1, done )
+	    << "\t(" << done << " polynomials)" << std::endl;
+  std::cout << "SAMPLES := " << samples << std::endl;
+  return complete ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 static void Usage( const std::string& programName )
 {
-  std::cerr << programName << " M (number of polynomials) N (number of trials) T(number threads)" << std::endl;
+  std::cerr << programName << " M (number of polynomials) N (number of trials) T(number threads) [SEED [K [mean|cv]]]\n"
+	    << "\tK > 1: groups of K polynomials share samples; mean: mean value estimator\n"
+	    << "\tcv (K = 1): mean value with a fitted control variate\n"
+	    << "\t[-tol REL] (K = 1) stop each integral at relative error REL, N at most\n"
+	    << "\t[-shard i/S] [-checkpoint FILE] [-interval SECONDS]\n"
+	    << programName << " -merge CHECKPOINT..." << std::endl;
 }
 int main(int argc, char* argv[])
 {
-  if( argc != 4 ) { Usage( argv[0] ); return (-1); }
-  const int M = atoi( argv[1] );
-  const int N = atoi( argv[2] );
-  const int T = atoi( argv[3] );
+  CHECKPOINT::Options options;
+  std::vector<std::string> args;
+  if( !options.parse( argc, argv, 1, args ) ) { Usage( argv[0] ); return (-1); }
+  if( !options.merge.empty() ) return MergeShards( options.merge );
+  double TOL = 0;
+  for( size_t i=0; i < args.size(); ++i ) {
+    if( args[i] != "-tol" ) continue;
+    if( i+1 == args.size() ) { Usage( argv[0] ); return (-1); }
+    TOL = std::atof( args[i+1].c_str() );
+    args.erase( args.begin()+i, args.begin()+i+2 );
+    break;
+  }
+  if( args.size() < 3 || args.size() > 6 ) { Usage( argv[0] ); return (-1); }
+  const int M = atoi( args[0].c_str() );
+  const int N = atoi( args[1].c_str() );
+  const int T = atoi( args[2].c_str() );
+  const uint64_t SEED = ( args.size() >= 4 ) ? std::stoull( args[3] ) : 1;
+  const uint64_t K = ( args.size() >= 5 ) ? std::max( 1, atoi( args[4].c_str() ) ) : 1;
+  ESTIMATOR E = ESTIMATOR::HIT_OR_MISS;
+  if( args.size() == 6 ) {
+    if( args[5] == "mean" ) E = ESTIMATOR::MEAN_VALUE;
+    else if( args[5] == "cv" ) E = ESTIMATOR::CONTROL_VARIATE;
+    else { Usage( argv[0] ); return (-1); }
+  }
+  if( ( TOL > 0 || E == ESTIMATOR::CONTROL_VARIATE ) && K > 1 ) { Usage( argv[0] ); return (-1); }
   omp_set_num_threads( T );
   std::cout << "Running MC Integration with " << omp_get_max_threads() << " OpenMP threads.\n";
-  TestMonteCarlo( M, N );
+  TestMonteCarlo( M, N, SEED, K, E, TOL, options );
   return ( EXIT_SUCCESS );
 }
 #if 0
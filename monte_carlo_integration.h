@@ -0,0 +1,538 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : monte_carlo_integration.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Sample-reject Monte Carlo integrator (MCI), shared by the
+//        : monte_carlo_integration driver and the benchmarks.
+//        : d-dimensional and quasi-Monte Carlo integration: quasi_monte_carlo.h
+//        : adaptive importance / stratified sampling (VEGAS): vegas.h
+//        : deterministic adaptive quadrature (Gauss-Kronrod, tanh-sinh): quadrature.h
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MONTE_CARLO_INTEGRATION_H
+#define MONTE_CARLO_INTEGRATION_H
+
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <limits>
+#include <cmath>
+#include "philox.h"
+#include "polynomial.h"
+
+namespace MonteCarloIntegration {
+  using UNIVARIATE_FUNCTION = std::function<double(double)>;
+
+  // Running mean and variance: Welford's update for one value, Chan et al.
+  // to fold in a batch given as (count, mean, sum of squared deviations).
+  // Neither subtracts two large sums, so the variance stays accurate.
+  struct RunningStats {
+    uint64_t n = 0;
+    double mean = 0, m2 = 0;
+    void add( double x ) {
+      ++n;
+      const double delta = x-mean;
+      mean += delta/n;
+      m2 += delta*( x-mean );
+    }
+    void merge( uint64_t nb, double mean_b, double m2_b ) {
+      if( nb == 0 ) return;
+      const uint64_t total = n+nb;
+      const double delta = mean_b-mean;
+      mean += delta*nb/total;
+      m2 += m2_b + delta*delta*( double(n)*nb/total );
+      n = total;
+    }
+    double variance() const { return ( n > 1 ) ? m2/( n-1 ) : 0.0; }
+    double std_error() const { return ( n > 1 ) ? std::sqrt( variance()/n ) : std::numeric_limits<double>::infinity(); }
+  };
+
+  // Stop once z * standard error <= max( absolute, relative*|estimate| ),
+  // checked every block samples after the first min_samples; never more
+  // than the integrator's N.
+  struct Tolerance {
+    double relative = 0, absolute = 0;
+    double z = 1.96; // 95% two sided
+    uint64_t block = uint64_t(1) << 14;
+    uint64_t min_samples = uint64_t(1) << 14;
+  };
+
+  struct MCIResult {
+    double estimate, std_error;
+    uint64_t samples;
+    bool converged;   // met the tolerance within N samples
+  };
+
+  // Hit or miss in blocks: sample i scores offset+scale if it hits, else offset.
+  template <typename HITS>
+  MCIResult HitsToTolerance( const HITS& hits, double offset, double scale, uint64_t N, const Tolerance& tol ) {
+    assert( tol.block > 0 );
+    RunningStats stats;
+    while( stats.n < N ) {
+      const uint64_t n = std::min( tol.block, N-stats.n );
+      const uint64_t h = hits( stats.n, stats.n+n );
+      // Block of h values offset+scale and n-h values offset.
+      stats.merge( n, offset + scale*h/n, scale*scale*( double(h)*(n-h)/n ) );
+      if( stats.n < tol.min_samples ) continue;
+      const double target = std::max( tol.absolute, tol.relative*std::abs( stats.mean ) );
+      if( tol.z*stats.std_error() <= target ) return MCIResult{ stats.mean, stats.std_error(), stats.n, true };
+    }
+    return MCIResult{ stats.mean, stats.std_error(), stats.n, false };
+  }
+
+  // HIT_OR_MISS: count y < f(x) for y uniform in [floor,ceiling) (two
+  // uniforms a sample). MEAN_VALUE: (B-A)*mean f(x), one uniform a sample,
+  // lower variance and no bounds needed. CONTROL_VARIATE: MEAN_VALUE of
+  // f - c*g, g a low degree least squares polynomial fit of f with exactly
+  // known integral, c the regression coefficient of f on g.
+  enum class ESTIMATOR { HIT_OR_MISS, MEAN_VALUE, CONTROL_VARIATE };
+  constexpr unsigned int CONTROL_VARIATE_DEGREE = 3;
+
+  // Hit or miss box [floor,ceiling) for f on [A,B], floor <= 0 <= ceiling.
+  // f is evaluated on a grid of 1024 intervals and the extremes are padded
+  // by the largest second difference, more than a smooth f can overshoot
+  // its grid values in between. No monotonicity assumed.
+  template <typename EVAL>
+  std::pair<double,double> SampleBounds( const EVAL& eval, double A, double B ) {
+    constexpr size_t GRID = 1024;
+    std::vector<double> x( GRID+1 ), fx( GRID+1 );
+    for( size_t i=0; i <= GRID; ++i ) x[i] = A + (B-A)*i/GRID;
+    eval( x.data(), fx.data(), GRID+1 );
+    double lo = 0, hi = 0, pad = 0;
+    for( size_t i=0; i <= GRID; ++i ) {
+      lo = std::min( lo, fx[i] );
+      hi = std::max( hi, fx[i] );
+      if( i && i < GRID ) pad = std::max( pad, std::abs( fx[i-1] - 2*fx[i] + fx[i+1] ) );
+    }
+    return { ( lo < 0 ) ? lo-pad : 0.0, ( hi > 0 ) ? hi+pad : 0.0 };
+  }
+
+  // Least squares polynomial of degree DEGREE through f at 4(DEGREE+1)
+  // Chebyshev points of [A,B]; solved in t = (2x-A-B)/(B-A), then expanded
+  // in x so Polynomial::Integral gives its exact integral.
+  template <typename EVAL>
+  Polynomial<double> FitControlVariate( const EVAL& eval, double A, double B, unsigned int DEGREE ) {
+    const size_t K = DEGREE+1, M = 4*K;
+    std::vector<double> x( M ), fx( M ), t( M );
+    for( size_t i=0; i < M; ++i ) {
+      t[i] = std::cos( M_PI*( i+0.5 )/M );
+      x[i] = ( A+B )/2 + ( B-A )/2*t[i];
+    }
+    eval( x.data(), fx.data(), M );
+    // Normal equations G a = r, Gaussian elimination with partial pivoting.
+    std::vector<double> G( K*K, 0.0 ), r( K, 0.0 ), a( K );
+    for( size_t i=0; i < M; ++i ) {
+      std::vector<double> pw( K, 1.0 );
+      for( size_t k=1; k < K; ++k ) pw[k] = pw[k-1]*t[i];
+      for( size_t k=0; k < K; ++k ) {
+	r[k] += pw[k]*fx[i];
+	for( size_t l=0; l < K; ++l ) G[k*K+l] += pw[k]*pw[l];
+      }
+    }
+    for( size_t c=0; c < K; ++c ) {
+      size_t piv = c;
+      for( size_t k=c+1; k < K; ++k ) if( std::abs( G[k*K+c] ) > std::abs( G[piv*K+c] ) ) piv = k;
+      for( size_t l=0; l < K; ++l ) std::swap( G[c*K+l], G[piv*K+l] );
+      std::swap( r[c], r[piv] );
+      for( size_t k=c+1; k < K; ++k ) {
+	const double m = G[k*K+c]/G[c*K+c];
+	for( size_t l=c; l < K; ++l ) G[k*K+l] -= m*G[c*K+l];
+	r[k] -= m*r[c];
+      }
+    }
+    for( size_t c=K; c-- > 0; ) {
+      double v = r[c];
+      for( size_t l=c+1; l < K; ++l ) v -= G[c*K+l]*a[l];
+      a[c] = v/G[c*K+c];
+    }
+    // t = s*x + o: sum_k a_k (s x + o)^k by Horner in t.
+    const double s = 2/( B-A ), o = -( A+B )/( B-A );
+    std::vector<double> q( K, 0.0 );
+    for( size_t k=K; k-- > 0; ) {
+      // q = q*(s x + o) + a_k
+      for( size_t l=K-1; l > 0; --l ) q[l] = q[l]*o + q[l-1]*s;
+      q[0] = q[0]*o + a[k];
+    }
+    Polynomial<double> retval( K );
+    for( size_t k=0; k < K; ++k ) retval.coefficient( k ) = q[k];
+    return retval;
+  }
+
+  // Mean and co-moments of (f,g): batches folded with the pairwise update
+  // of Chan et al., as RunningStats.
+  struct RunningCovariance {
+    uint64_t n = 0;
+    double mf = 0, mg = 0, cff = 0, cgg = 0, cfg = 0;
+    void merge( const RunningCovariance& b ) {
+      if( b.n == 0 ) return;
+      const uint64_t total = n+b.n;
+      const double df = b.mf-mf, dg = b.mg-mg, w = double(n)*b.n/total;
+      mf += df*b.n/total;
+      mg += dg*b.n/total;
+      cff += b.cff + df*df*w;
+      cgg += b.cgg + dg*dg*w;
+      cfg += b.cfg + df*dg*w;
+      n = total;
+    }
+    // Two pass moments of one batch of m values.
+    static RunningCovariance batch( const double* f, const double* g, size_t m ) {
+      RunningCovariance retval;
+      retval.n = m;
+      for( size_t j=0; j < m; ++j ) { retval.mf += f[j]; retval.mg += g[j]; }
+      retval.mf /= m;
+      retval.mg /= m;
+      for( size_t j=0; j < m; ++j ) {
+	const double df = f[j]-retval.mf, dg = g[j]-retval.mg;
+	retval.cff += df*df;
+	retval.cgg += dg*dg;
+	retval.cfg += df*dg;
+      }
+      return retval;
+    }
+  };
+
+  // Sample-mean estimate over samples [0,N): both uniforms of Philox pairs
+  // [0,N/2), plus the first uniform of pair N/2 when N is odd. They are
+  // drawn in chunks of up to 512 samples; the chunk at sample s uses up to
+  // 256 pairs from s/2 on and holds all their first uniforms, then all
+  // their second ones. With a control variate g (integral G over [A,B])
+  // the estimate is (B-A)*( mean f - c*( mean g - G/(B-A) ) ).
+  template <typename EVAL>
+  MCIResult MeanValueToTolerance( const EVAL& eval, const PhiloxStream& rng, double A, double B, uint64_t N,
+				  const Polynomial<double>* cv, const Tolerance& tol ) {
+    assert( tol.block > 0 );
+    constexpr size_t PAIRS = 256;
+    alignas(64) double x[2*PAIRS], fx[2*PAIRS], gx[2*PAIRS];
+    if( !cv ) std::fill( gx, gx+2*PAIRS, 0.0 );
+    const double G = cv ? cv->Integral( A, B )/( B-A ) : 0.0;
+    RunningCovariance stats;
+    auto result = [&]( bool converged ) {
+      double mean = stats.mf, resid = stats.cff;
+      if( cv && stats.cgg > 0 ) {
+	const double c = stats.cfg/stats.cgg;
+	mean -= c*( stats.mg-G );
+	resid = std::max( 0.0, stats.cff - c*stats.cfg );
+      }
+      const double err = ( stats.n > 1 ) ? std::sqrt( resid/( stats.n-1 )/stats.n ) : std::numeric_limits<double>::infinity();
+      return MCIResult{ (B-A)*mean, (B-A)*err, stats.n, converged };
+    };
+    while( stats.n < N ) {
+      const uint64_t end = std::min( N, stats.n + std::max<uint64_t>( 2, tol.block & ~uint64_t(1) ) );
+      for( uint64_t s=stats.n; s < end; ) {
+	const size_t m = static_cast<size_t>( std::min<uint64_t>( 2*PAIRS, end-s ) );
+	const size_t pairs = ( m+1 )/2;
+	rng.fill_pairs( s/2, pairs, x, x+pairs ); // m odd: last second uniform unused
+	MCI_SIMD
+	for( size_t j=0; j < m; ++j ) x[j] = A + (B-A)*x[j];
+	eval( x, fx, m );
+	if( cv ) cv->evaluate( x, gx, m );
+	stats.merge( RunningCovariance::batch( fx, gx, m ) );
+	s += m;
+      }
+      if( stats.n < tol.min_samples ) continue;
+      const MCIResult r = result( false );
+      const double target = std::max( tol.absolute, tol.relative*std::abs( r.estimate ) );
+      if( tol.z*r.std_error <= target ) return result( true );
+    }
+    return result( false );
+  }
+
+  class MCI
+  {
+  public:
+    MCI( double A, double B, int N, const UNIVARIATE_FUNCTION& F ):
+      m_A{A}, m_B{B}, m_N{N}, m_F{F}, m_RNG{ PhiloxStream::unique() } { SetupRNG(); }
+    // Reproducible: (Seed, Stream) fixes the samples; integrators given
+    // different streams of one seed draw independent samples.
+    MCI( double A, double B, int N, const UNIVARIATE_FUNCTION& F, uint64_t Seed, uint64_t Stream = 0 ):
+      m_A{A}, m_B{B}, m_N{N}, m_F{F}, m_RNG{ Seed, Stream } { SetupRNG(); }
+    double Integral() const;
+    // As Integral(), but stops early once the estimate meets tol.
+    MCIResult Integral( const Tolerance& tol ) const {
+      return HitsToTolerance( [this]( uint64_t lo, uint64_t hi ) { return Hits( lo, hi ); },
+			      (m_B-m_A)*MINIMUM_VALUE_OF_FUNCTION,
+			      (m_B-m_A)*(MAXIMUM_VALUE_OF_FUNCTION-MINIMUM_VALUE_OF_FUNCTION), m_N, tol );
+    }
+    // Any estimator; the default tolerance runs all N samples.
+    MCIResult Integral( ESTIMATOR E, const Tolerance& tol = Tolerance() ) const {
+      if( E == ESTIMATOR::HIT_OR_MISS ) return Integral( tol );
+      auto eval = [this]( const double* x, double* fx, size_t n ) { for( size_t j=0; j < n; ++j ) fx[j] = m_F( x[j] ); };
+      if( E == ESTIMATOR::MEAN_VALUE ) return MeanValueToTolerance( eval, m_RNG, m_A, m_B, m_N, nullptr, tol );
+      const Polynomial<double> g = FitControlVariate( eval, m_A, m_B, CONTROL_VARIATE_DEGREE );
+      return MeanValueToTolerance( eval, m_RNG, m_A, m_B, m_N, &g, tol );
+    }
+    // Hits among samples [first,last); sums of disjoint ranges, computed by
+    // any number of threads, add up to exactly the serial count.
+    uint64_t Hits( uint64_t first, uint64_t last ) const;
+  private:
+    void SetupRNG();
+  protected:
+    double m_A, m_B;
+    int m_N;
+    const UNIVARIATE_FUNCTION m_F; // a copy: callers may pass a temporary
+    PhiloxStream m_RNG;
+    double MAXIMUM_VALUE_OF_FUNCTION, MINIMUM_VALUE_OF_FUNCTION;
+  };
+};
+
+inline void MonteCarloIntegration::MCI::SetupRNG()
+{
+  // Assumption 1 (f monotonic, so its max is f(A) or f(B)) is gone: the
+  // box comes from a padded grid scan and may go below zero.
+  const auto bounds = SampleBounds( [this]( const double* x, double* fx, size_t n ) {
+      for( size_t j=0; j < n; ++j ) fx[j] = m_F( x[j] );
+    }, m_A, m_B );
+  MINIMUM_VALUE_OF_FUNCTION = bounds.first;
+  MAXIMUM_VALUE_OF_FUNCTION = bounds.second;
+  //std::cout << "Function in : " << MINIMUM_VALUE_OF_FUNCTION << "\t" << MAXIMUM_VALUE_OF_FUNCTION << std::endl;
+
+  if(false){
+    std::ofstream f("a.dat");
+    for( int i=0; i < 100; ++i ) { 
+      auto u = m_RNG.uniform_pair( i );
+      double x = m_A + (m_B-m_A)*u.first;
+      f << x << "\t" << m_F(x) << "\t" << MINIMUM_VALUE_OF_FUNCTION + (MAXIMUM_VALUE_OF_FUNCTION-MINIMUM_VALUE_OF_FUNCTION)*u.second << "\n";
+    }
+  }
+  #if 0
+  // Generate a normal distribution around that mean
+  std::seed_seq seed2{r(), r(), r(), r(), r(), r(), r(), r()}; 
+  std::mt19937 e2(seed2);
+  std::normal_distribution<> normal_dist(mean, 2);
+  #endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Originally the plan was for multiple random evals in this loop for the
+// trials, but the per thread mt19937 streams were correlated, so whole
+// polynomials were computed in parallel instead. Sample i now comes from
+// the counter (i, stream) of a Philox generator (philox.h): the trials of
+// one integral can be split over threads with Hits() and the count is the
+// same for any split. The polynomials have the same domain, so the X rng
+// can be shared, reducing the work: see MultiMCI below. In future we want
+// to explore multiple domains.
+//
+////////////////////////////////////////////////////////////////////////////////
+inline uint64_t MonteCarloIntegration::MCI::Hits( uint64_t first, uint64_t last ) const
+{
+  constexpr size_t BLOCK = 256;
+  double u0[BLOCK], u1[BLOCK];
+  uint64_t retval=0;
+  for( ; first < last; first += BLOCK ) {
+    const size_t n = static_cast<size_t>( std::min<uint64_t>( BLOCK, last-first ) );
+    m_RNG.fill_pairs( first, n, u0, u1 );
+    for( size_t j=0; j < n; ++j ) {
+      double x = m_A + (m_B-m_A)*u0[j];
+      double y = MINIMUM_VALUE_OF_FUNCTION + (MAXIMUM_VALUE_OF_FUNCTION-MINIMUM_VALUE_OF_FUNCTION)*u1[j];
+      //std::cout << "Trial " << first+j << "\t X = " << x << "\t f(x) = " << m_F(x) << "\t Y = " << y << "\n";
+      if( y < m_F(x) ) retval++;
+    }
+  }
+  return retval;
+}
+
+inline double MonteCarloIntegration::MCI::Integral() const
+{
+  const double retval = static_cast<double>( Hits( 0, m_N ) );
+  const double height = MAXIMUM_VALUE_OF_FUNCTION-MINIMUM_VALUE_OF_FUNCTION;
+  return (m_B-m_A)*(MINIMUM_VALUE_OF_FUNCTION + (height*retval)/(double)m_N);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Batched MCI: same samples as MCI with the same (Seed, Stream), but the
+// integrand is a template parameter, so there is no std::function call per
+// sample. Uniforms are drawn a block at a time (PhiloxStream::fill_pairs),
+// the integrand runs over the whole block and the hits are counted with one
+// compare per lane; all three loops vectorize. F is either a scalar callable
+// double(double), inlined into the block loop, or a block callable
+// void(const double* x, double* fx, size_t n) such as Polynomial::evaluate;
+// the evaluators of Polynomial<T,N> (horner(), estrin()) are both and are
+// taken as blocks.
+////////////////////////////////////////////////////////////////////////////////
+namespace MonteCarloIntegration {
+  template <typename F>
+  class BatchMCI
+  {
+  public:
+    static constexpr size_t BLOCK = 256;
+
+    BatchMCI( double A, double B, int N, F Fn, uint64_t Seed, uint64_t Stream = 0 ):
+      m_A{A}, m_B{B}, m_N{N}, m_F{std::move(Fn)}, m_RNG{ Seed, Stream } { SetupBounds(); }
+    BatchMCI( double A, double B, int N, F Fn ):
+      m_A{A}, m_B{B}, m_N{N}, m_F{std::move(Fn)}, m_RNG{ PhiloxStream::unique() } { SetupBounds(); }
+
+    double Integral() const {
+      const double retval = static_cast<double>( Hits( 0, m_N ) );
+      const double height = MAXIMUM_VALUE_OF_FUNCTION-MINIMUM_VALUE_OF_FUNCTION;
+      return (m_B-m_A)*(MINIMUM_VALUE_OF_FUNCTION + (height*retval)/(double)m_N);
+    }
+    MCIResult Integral( const Tolerance& tol ) const {
+      return HitsToTolerance( [this]( uint64_t lo, uint64_t hi ) { return Hits( lo, hi ); },
+			      (m_B-m_A)*MINIMUM_VALUE_OF_FUNCTION,
+			      (m_B-m_A)*(MAXIMUM_VALUE_OF_FUNCTION-MINIMUM_VALUE_OF_FUNCTION), m_N, tol );
+    }
+    MCIResult Integral( ESTIMATOR E, const Tolerance& tol = Tolerance() ) const {
+      if( E == ESTIMATOR::HIT_OR_MISS ) return Integral( tol );
+      auto eval = [this]( const double* x, double* fx, size_t n ) { Evaluate( x, fx, n ); };
+      if( E == ESTIMATOR::MEAN_VALUE ) return MeanValueToTolerance( eval, m_RNG, m_A, m_B, m_N, nullptr, tol );
+      const Polynomial<double> g = FitControlVariate( eval, m_A, m_B, CONTROL_VARIATE_DEGREE );
+      return MeanValueToTolerance( eval, m_RNG, m_A, m_B, m_N, &g, tol );
+    }
+    uint64_t Hits( uint64_t first, uint64_t last ) const {
+      alignas(64) double x[BLOCK], y[BLOCK], fx[BLOCK];
+      uint64_t retval = 0;
+      for( ; first < last; first += BLOCK ) {
+	const size_t n = static_cast<size_t>( std::min<uint64_t>( BLOCK, last-first ) );
+	m_RNG.fill_pairs( first, n, x, y );
+	MCI_SIMD
+	for( size_t j=0; j < n; ++j ) {
+	  x[j] = m_A + (m_B-m_A)*x[j];
+	  y[j] = MINIMUM_VALUE_OF_FUNCTION + (MAXIMUM_VALUE_OF_FUNCTION-MINIMUM_VALUE_OF_FUNCTION)*y[j];
+	}
+	Evaluate( x, fx, n );
+	uint64_t hits = 0;
+	MCI_SIMD_SUM(hits)
+	for( size_t j=0; j < n; ++j ) hits += ( y[j] < fx[j] );
+	retval += hits;
+      }
+      return retval;
+    }
+  private:
+    static constexpr bool BLOCK_CALLABLE = std::is_invocable_v<const F&, const double*, double*, size_t>;
+
+    void Evaluate( const double* x, double* fx, size_t n ) const {
+      if constexpr( BLOCK_CALLABLE ) m_F( x, fx, n );
+      else for( size_t j=0; j < n; ++j ) fx[j] = m_F( x[j] );
+    }
+    void SetupBounds() {
+      const auto bounds = SampleBounds( [this]( const double* x, double* fx, size_t n ) { Evaluate( x, fx, n ); }, m_A, m_B );
+      MINIMUM_VALUE_OF_FUNCTION = bounds.first;
+      MAXIMUM_VALUE_OF_FUNCTION = bounds.second;
+    }
+
+    double m_A, m_B;
+    int m_N;
+    F m_F;
+    PhiloxStream m_RNG;
+    double MAXIMUM_VALUE_OF_FUNCTION, MINIMUM_VALUE_OF_FUNCTION;
+  };
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// K polynomials on one domain share their samples: each x (and the uniform
+// behind y) is drawn once and all K polynomials are evaluated at it in one
+// Horner sweep over a struct-of-arrays coefficient matrix, C[i*K+k] the
+// coefficient of x^i in polynomial k, so the inner loop runs over k with
+// unit stride and vectorizes. Per sample that is one Philox call instead of
+// K, and K lanes of Horner instead of K scalar ones.
+//
+// HIT_OR_MISS is the sample-reject estimate of MCI (y = floor_k + u*height_k
+// with the bounds of SampleBounds, so a polynomial's samples do not depend on
+// which group it is in). MEAN_VALUE is (B-A)*mean(p_k(x)), which needs no y
+// and has lower variance (CONTROL_VARIATE is not offered: a polynomial is
+// its own exact control variate). Estimates of different polynomials of a
+// group are correlated through the shared samples; each one on its own is
+// unbiased.
+////////////////////////////////////////////////////////////////////////////////
+namespace MonteCarloIntegration {
+  class MultiMCI
+  {
+  public:
+    static constexpr size_t BLOCK = 256;
+
+    MultiMCI( double A, double B, int N, const std::vector< Polynomial<double> >& P, uint64_t Seed, uint64_t Stream = 0 ):
+      m_A{A}, m_B{B}, m_N{N}, K{ P.size() }, m_RNG{ Seed, Stream } {
+      assert( K > 0 );
+      for( const auto& p : P ) D = std::max( D, p.size() );
+      C.assign( D*K, 0.0 );
+      for( size_t k=0; k < K; ++k )
+	for( size_t i=0; i < P[k].size(); ++i ) C[i*K+k] = P[k].coefficient( i );
+      MINIMUM_VALUE_OF_FUNCTION.resize( K );
+      HEIGHT.resize( K );
+      for( size_t k=0; k < K; ++k ) {
+	const Polynomial<double>& p = P[k];
+	const auto bounds = SampleBounds( [&p]( const double* x, double* fx, size_t n ) { p.evaluate( x, fx, n ); }, m_A, m_B );
+	MINIMUM_VALUE_OF_FUNCTION[k] = bounds.first;
+	HEIGHT[k] = bounds.second-bounds.first;
+      }
+    }
+
+    size_t count() const { return K; }
+
+    // One estimate per polynomial, in the order given.
+    std::vector<double> Integrals( ESTIMATOR E = ESTIMATOR::HIT_OR_MISS ) const {
+      assert( E != ESTIMATOR::CONTROL_VARIATE );
+      std::vector<double> retval( K );
+      if( E == ESTIMATOR::HIT_OR_MISS ) {
+	const std::vector<uint64_t> hits = Hits( 0, m_N );
+	for( size_t k=0; k < K; ++k )
+	  retval[k] = (m_B-m_A)*(MINIMUM_VALUE_OF_FUNCTION[k] + (HEIGHT[k]*hits[k])/(double)m_N);
+      } else {
+	const std::vector<double> sums = Sums( 0, m_N );
+	for( size_t k=0; k < K; ++k ) retval[k] = (m_B-m_A)*sums[k]/(double)m_N;
+      }
+      return retval;
+    }
+
+    // Per polynomial hits / sums of p_k(x) over samples [first,last).
+    std::vector<uint64_t> Hits( uint64_t first, uint64_t last ) const {
+      std::vector<uint64_t> hits( K, 0 );
+      Sweep( first, last, [&]( double u, const double* fx ) {
+	  const double* floor = MINIMUM_VALUE_OF_FUNCTION.data();
+	  const double* height = HEIGHT.data();
+	  uint64_t* h = hits.data();
+	  MCI_SIMD
+	  for( size_t k=0; k < K; ++k ) h[k] += ( floor[k] + u*height[k] < fx[k] );
+	} );
+      return hits;
+    }
+    std::vector<double> Sums( uint64_t first, uint64_t last ) const {
+      std::vector<double> sums( K, 0.0 );
+      Sweep( first, last, [&]( double, const double* fx ) {
+	  double* s = sums.data();
+	  MCI_SIMD
+	  for( size_t k=0; k < K; ++k ) s[k] += fx[k];
+	} );
+      return sums;
+    }
+  private:
+    // Calls use( u, fx ) for every sample, fx[k] = p_k(x), u the y uniform.
+    template <typename USE>
+    void Sweep( uint64_t first, uint64_t last, const USE& use ) const {
+      alignas(64) double x[BLOCK], u[BLOCK];
+      std::vector<double> fx( K );
+      double* y = fx.data();
+      const double* c = C.data();
+      for( ; first < last; first += BLOCK ) {
+	const size_t n = static_cast<size_t>( std::min<uint64_t>( BLOCK, last-first ) );
+	m_RNG.fill_pairs( first, n, x, u );
+	for( size_t j=0; j < n; ++j ) {
+	  const double xj = m_A + (m_B-m_A)*x[j];
+	  const double* top = c + (D-1)*K;
+	  MCI_SIMD
+	  for( size_t k=0; k < K; ++k ) y[k] = top[k];
+	  for( size_t i=D-1; i-- > 0; ) {
+	    const double* ci = c + i*K;
+	    MCI_SIMD
+	    for( size_t k=0; k < K; ++k ) y[k] = ci[k] + y[k]*xj;
+	  }
+	  use( u[j], y );
+	}
+      }
+    }
+
+    double m_A, m_B;
+    int m_N;
+    size_t K, D = 0;
+    std::vector<double> C; // D x K, coefficient of x^i of polynomial k at i*K+k
+    std::vector<double> MINIMUM_VALUE_OF_FUNCTION, HEIGHT; // hit or miss box of each polynomial
+    PhiloxStream m_RNG;
+  };
+};
+
+#endif // MONTE_CARLO_INTEGRATION_H
@@ -0,0 +1,179 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : parallel_algorithms.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Data parallel loops on THREAD_POOL::ThreadPool
+//
+// parallel_for    : f(i) for i in [first,last)
+// parallel_reduce : combine over map(i), one partial per worker slot
+// parallel_scan   : inclusive prefix scan, two passes over blocks
+//
+// Ranges are split recursively: a chunk task keeps halving its range and
+// hands the upper half back to the pool until it is below the grain, so with
+// WORK_STEALING idle workers steal the largest pieces first. A grain of 0
+// picks range/(8*MAX_THREADS). The calling thread helps run tasks while it
+// waits, so loops may be nested inside pool tasks (or run on a pool without
+// workers) without deadlock.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "threadpool.h"
+#include <iterator>
+#include <type_traits>
+
+#pragma once
+
+namespace THREAD_POOL {
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Fork/join group: run() adds a task, wait() helps until all have finished
+  // and rethrows the first exception raised by one of them.
+  ////////////////////////////////////////////////////////////////////////////////
+  class TaskGroup {
+  public:
+    explicit TaskGroup( ThreadPool& Pool ): pool{Pool} {}
+    TaskGroup( const TaskGroup& ) = delete;
+    TaskGroup& operator=( const TaskGroup& ) = delete;
+    ~TaskGroup() { assert( pending.load() == 0 && "TaskGroup destroyed before wait()." ); }
+
+    ThreadPool& get_pool() const { return pool; }
+
+    template <typename F>
+    void run( F&& f ) {
+      pending.fetch_add( 1, std::memory_order_relaxed );
+      pool.add( [ this, func = std::forward<F>( f ) ]() mutable {
+	  try {
+	    func();
+	  } catch( ... ) {
+	    std::unique_lock<std::mutex> lock{ mutex };
+	    if( !error ) error = std::current_exception();
+	  }
+	  // Last touch of the group: wait() may return right after this.
+	  pending.fetch_sub( 1, std::memory_order_release );
+	} );
+    }
+
+    void wait() {
+      pool.help_while( [this]() { return pending.load( std::memory_order_acquire ) != 0; } );
+      if( error ) {
+	std::exception_ptr e = error;
+	error = nullptr;
+	std::rethrow_exception( e );
+      }
+    }
+  private:
+    ThreadPool& pool;
+    std::atomic<size_t> pending{0};
+    std::mutex mutex;
+    std::exception_ptr error;
+  };
+
+  namespace DETAIL {
+    template <typename Index>
+    Index grain_size( const ThreadPool& pool, Index first, Index last, Index grain ) {
+      if( grain > 0 ) return grain;
+      const Index n = last-first;
+      const Index chunks = static_cast<Index>( 8*pool.max_threads() );
+      return ( n/chunks > 0 ) ? n/chunks : Index(1);
+    }
+
+    // Split [first,last) down to grain, handing upper halves to the group,
+    // then run chunk(lo,hi) on what is left.
+    template <typename Index, typename CHUNK>
+    void split_range( TaskGroup& group, Index first, Index last, Index grain, const CHUNK& chunk ) {
+      while( last-first > grain ) {
+	const Index mid = first + (last-first)/2;
+	group.run( [&group, mid, last, grain, &chunk]() { split_range( group, mid, last, grain, chunk ); } );
+	last = mid;
+      }
+      chunk( first, last );
+    }
+
+    // Splits on the calling thread and waits; if the inline chunk throws,
+    // the tasks already handed out still reference this frame, so wait first.
+    template <typename Index, typename CHUNK>
+    void run_chunks( ThreadPool& pool, Index first, Index last, Index grain, const CHUNK& chunk ) {
+      TaskGroup group( pool );
+      try {
+	split_range( group, first, last, grain, chunk );
+      } catch( ... ) {
+	try { group.wait(); } catch( ... ) {}
+	throw;
+      }
+      group.wait();
+    }
+
+    // Per worker accumulator, cache line padded. The non-worker slot
+    // (index MAX_THREADS) can be shared by several threads and is locked.
+    template <typename T>
+    struct alignas(64) Partial {
+      T value;
+      bool valid = false;
+    };
+  }
+
+  template <typename Index, typename F>
+  void parallel_for( ThreadPool& pool, Index first, Index last, const F& f, Index grain = 0 )
+  {
+    if( !( first < last ) ) return;
+    grain = DETAIL::grain_size( pool, first, last, grain );
+    auto chunk = [&f]( Index lo, Index hi ) { for( Index i=lo; i < hi; ++i ) f( i ); };
+    DETAIL::run_chunks( pool, first, last, grain, chunk );
+  }
+
+  // Combine must be associative; partials are folded in worker order, so
+  // floating point sums may differ in the last bits between runs.
+  template <typename Index, typename T, typename MAP, typename COMBINE>
+  T parallel_reduce( ThreadPool& pool, Index first, Index last, T identity,
+		     const MAP& map, const COMBINE& combine, Index grain = 0 )
+  {
+    if( !( first < last ) ) return identity;
+    grain = DETAIL::grain_size( pool, first, last, grain );
+    const unsigned int SLOTS = pool.max_threads()+1;
+    std::vector< DETAIL::Partial<T> > partials( SLOTS );
+    std::mutex shared_slot;
+    auto chunk = [&]( Index lo, Index hi ) {
+      T acc = identity;
+      for( Index i=lo; i < hi; ++i ) acc = combine( std::move( acc ), map( i ) );
+      // Fold once per chunk; nothing in between can re-enter this slot.
+      const unsigned int w = pool.worker_index();
+      std::unique_lock<std::mutex> lock{ shared_slot, std::defer_lock };
+      if( w == SLOTS-1 ) lock.lock();
+      DETAIL::Partial<T>& p = partials[w];
+      p.value = p.valid ? combine( std::move( p.value ), std::move( acc ) ) : std::move( acc );
+      p.valid = true;
+    };
+    DETAIL::run_chunks( pool, first, last, grain, chunk );
+    T retval = identity;
+    for( auto& p : partials ) if( p.valid ) retval = combine( std::move( retval ), std::move( p.value ) );
+    return retval;
+  }
+
+  // Inclusive scan of [first,last) into out, which may alias first; blocks
+  // are indexed directly, so both need random access iterators.
+  // Pass 1 reduces each block, the block totals are scanned serially, pass 2
+  // rescans each block seeded with its prefix.
+  template <typename RandomIt, typename RandomOutIt, typename T, typename OP>
+  void parallel_scan( ThreadPool& pool, RandomIt first, RandomIt last, RandomOutIt out, T identity, const OP& op )
+  {
+    static_assert( std::is_base_of_v< std::random_access_iterator_tag, typename std::iterator_traits<RandomIt>::iterator_category > &&
+		   std::is_base_of_v< std::random_access_iterator_tag, typename std::iterator_traits<RandomOutIt>::iterator_category >,
+		   "parallel_scan needs random access iterators." );
+    using Index = typename std::iterator_traits<RandomIt>::difference_type;
+    const Index n = std::distance( first, last );
+    if( n <= 0 ) return;
+    const Index block = DETAIL::grain_size( pool, Index(0), n, Index(0) );
+    const Index blocks = ( n+block-1 )/block;
+    std::vector<T> totals( blocks, identity );
+    parallel_for( pool, Index(0), blocks, [&]( Index b ) {
+	T acc = identity;
+	for( Index i=b*block, e=std::min( n, i+block ); i < e; ++i ) acc = op( std::move( acc ), first[i] );
+	totals[b] = std::move( acc );
+      }, Index(1) );
+    T carry = identity;
+    for( auto& t : totals ) { T next = op( carry, t ); t = std::move( carry ); carry = std::move( next ); }
+    parallel_for( pool, Index(0), blocks, [&]( Index b ) {
+	T acc = totals[b];
+	for( Index i=b*block, e=std::min( n, i+block ); i < e; ++i ) { acc = op( std::move( acc ), first[i] ); out[i] = acc; }
+      }, Index(1) );
+  }
+
+} // end of namespace THREAD_POOL
@@ -2,26 +2,90 @@
 #define POLYNOMIAL_H
 
 #include <vector>
+#include <array>
 #include <iostream>
 #include <random>
 #include <functional>
+#include <cstdint>
+#include <cassert>
+#include <utility>
+#include <algorithm>
+#if __cplusplus > 201703L && __has_include(<span>)
+#include <span>
+#endif
+#include "polynomial_simd.h"
+
+// Polynomial<T> holds its coefficients on the heap and is sized at run
+// time; Polynomial<T,N> has N coefficients (degree N-1) fixed at compile
+// time, with constexpr unrolled evaluators. N = 0 is the run time size.
+constexpr size_t DYNAMIC_SIZE = 0;
+template <typename T, size_t N = DYNAMIC_SIZE> class Polynomial;
 
 template <typename T>
-class Polynomial: std::vector<T>
+class Polynomial<T, DYNAMIC_SIZE>: std::vector<T>
 {
   using V = std::vector<T>;
 public:
   explicit Polynomial(size_t N): V(N) {}
   void RandomCoefficients();    
+  void RandomCoefficients( uint64_t seed ); // reproducible
+  using V::size;
+  T coefficient( size_t i ) const { return (*this)[i]; }
+  T& coefficient( size_t i ) { return (*this)[i]; }
   Polynomial( const std::initializer_list<T>& input ): V{input} {}
+  // Coefficients from x^0 up, for polynomial_arithmetic.h and other bulk users.
+  explicit Polynomial( std::vector<T> c ): V( std::move( c ) ) {}
+  const std::vector<T>& coefficients() const { return *this; }
   template <typename U>
   friend std::ostream& operator<<( std::ostream& os, const Polynomial<U>& P);
   double Integral( double A, double B ) const;
+  // Horner without std::function, for callers that can inline it.
+  T operator()( T x ) const {
+    T b = (*this)[this->size()-1];
+    for( int i=static_cast<int>(this->size())-2; i >= 0; --i ) b = (*this)[i] + b*x;
+    return b;
+  }
+  // y[j] = P(x[j]) for j < n; coefficient loop outside, so the inner loop
+  // over the points vectorizes.
+  void evaluate( const T* x, T* y, size_t n ) const {
+    const T top = (*this)[this->size()-1];
+    for( size_t j=0; j < n; ++j ) y[j] = top;
+    for( int i=static_cast<int>(this->size())-2; i >= 0; --i ) {
+      const T c = (*this)[i];
+      for( size_t j=0; j < n; ++j ) y[j] = c + y[j]*x[j];
+    }
+  }
+  // Bulk evaluation, Estrin on the widest SIMD lanes the CPU has
+  // (polynomial_simd.h); agrees with evaluate() to rounding, not bitwise.
+  void evaluate_bulk( const T* x, T* y, size_t n ) const {
+    POLYNOMIAL_SIMD::evaluate( V::data(), this->size(), x, y, n );
+  }
+  // K polynomials at the same n points: y[k*n+j] = P[k](x[j]). The points
+  // go in blocks that stay in L1 while every polynomial runs over them.
+  static void evaluate_bulk( const std::vector<Polynomial>& P, const T* x, T* y, size_t n ) {
+    constexpr size_t BLOCK = 512;
+    for( size_t j=0; j < n; j += BLOCK ) {
+      const size_t m = std::min( BLOCK, n-j );
+      for( size_t k=0; k < P.size(); ++k ) P[k].evaluate_bulk( x+j, y+k*n+j, m );
+    }
+  }
+#ifdef __cpp_lib_span
+  void evaluate( std::span<const T> x, std::span<T> out ) const {
+    assert( out.size() >= x.size() );
+    evaluate_bulk( x.data(), out.data(), x.size() );
+  }
+  // out holds P.size() rows of x.size() values.
+  static void evaluate( const std::vector<Polynomial>& P, std::span<const T> x, std::span<T> out ) {
+    assert( out.size() >= P.size()*x.size() );
+    evaluate_bulk( P, x.data(), out.data(), x.size() );
+  }
+#endif
+  // The lambdas hold a copy of the coefficients, so they outlive *this.
   std::function<double(double)> getHorner() const {
-    auto constructed_lambda = [=](double x) -> double {
-      double b = (*this)[this->size()-1];
-      for( int i=static_cast<int>(this->size())-2; i >= 0; --i ) {
-	b = (*this)[i] + b*x;
+    auto constructed_lambda = [c = static_cast<const V&>( *this )](double x) -> double {
+      double b = c[c.size()-1];
+      for( int i=static_cast<int>(c.size())-2; i >= 0; --i ) {
+	b = c[i] + b*x;
       }
       return b;
     };
@@ -34,10 +98,10 @@ public:
       for( int i=0; i < n; ++i ) retval *= x;
       return retval;
     };
-    auto constructed_lambda= [=](double x) -> double {
+    auto constructed_lambda= [=, c = static_cast<const V&>( *this )](double x) -> double {
       double retval = 0;
       int counter = 0;
-      for( auto coeff : (*this) ) { retval += raise_to_power(x,counter++)*coeff; }
+      for( auto coeff : c ) { retval += raise_to_power(x,counter++)*coeff; }
       return retval;
     };
     return constructed_lambda;
@@ -45,7 +109,7 @@ public:
 };
 
 template <typename T>
-double Polynomial<T>::Integral( double A, double B ) const
+double Polynomial<T, DYNAMIC_SIZE>::Integral( double A, double B ) const
 {
   Polynomial<T> temp( this->size()+1 );
   for( size_t i=1; i < this->size(); ++i ) {
@@ -65,13 +129,127 @@ std::ostream& operator<<( std::ostream& os, const Polynomial<T>& P )
 }
 
 template <typename T>
-void Polynomial<T>::RandomCoefficients()
+void Polynomial<T, DYNAMIC_SIZE>::RandomCoefficients()
 {
   std::random_device rd;  // produces a seed
-  std::mt19937 gen(rd()); 
+  RandomCoefficients( rd() );
+}
+
+template <typename T>
+void Polynomial<T, DYNAMIC_SIZE>::RandomCoefficients( uint64_t seed )
+{
+  std::seed_seq seq{ uint32_t(seed), uint32_t(seed >> 32) };
+  std::mt19937 gen(seq); 
   //std::uniform_int_distribution<> distribution(0,100);
   std::uniform_real_distribution<>  distribution(0,1.0);
   for( auto& coeff : (*this) ) coeff = distribution(gen);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Fixed size polynomial: N coefficients in a std::array, c[i] the
+// coefficient of x^i. Evaluation is unrolled at compile time (pack
+// expansions, no loops over N) and constexpr:
+//   Horner : N-1 dependent multiply-adds, fewest operations
+//   Estrin : pairs a + b x, then x^2, x^4, ..; about log2(N) dependent
+//            steps, so the multiply-adds of a level run in parallel
+// horner() and estrin() return the evaluator by value, a concrete
+// callable holding its own coefficients: f(x) for one point and
+// f(x, y, n) for a block, so BatchMCI and the other templates inline it
+// (no std::function, nothing to dangle).
+////////////////////////////////////////////////////////////////////////////////
+namespace POLYNOMIAL_DETAIL {
+  template <typename T, size_t N, size_t... I>
+  constexpr T horner( const std::array<T,N>& c, [[maybe_unused]] T x, std::index_sequence<I...> ) {
+    T b = c[N-1];
+    ( ( b = c[N-2-I] + b*x ), ... );
+    return b;
+  }
+
+  template <typename T, size_t N, size_t... I>
+  constexpr std::array<T,(N+1)/2> estrin_level( const std::array<T,N>& c, T x, std::index_sequence<I...> ) {
+    return { ( ( 2*I+1 < N ) ? c[2*I] + c[( 2*I+1 < N ) ? 2*I+1 : 0]*x : c[2*I] )... };
+  }
+
+  template <typename T, size_t N>
+  constexpr T estrin( const std::array<T,N>& c, T x ) {
+    if constexpr( N == 1 ) return c[0];
+    else return estrin( estrin_level( c, x, std::make_index_sequence<(N+1)/2>{} ), x*x );
+  }
+}
+
+template <typename T, size_t N>
+struct HornerEvaluator {
+  std::array<T,N> c;
+  constexpr T operator()( T x ) const { return POLYNOMIAL_DETAIL::horner( c, x, std::make_index_sequence<N-1>{} ); }
+  // Block: one pass over the points per coefficient, as Polynomial<T>::evaluate.
+  void operator()( const T* x, T* y, size_t n ) const { block( x, y, n, std::make_index_sequence<N-1>{} ); }
+private:
+  template <size_t... I>
+  void block( const T* x, T* y, size_t n, std::index_sequence<I...> ) const {
+    for( size_t j=0; j < n; ++j ) y[j] = c[N-1];
+    ( [&]( const T ci ) { for( size_t j=0; j < n; ++j ) y[j] = ci + y[j]*x[j]; }( c[N-2-I] ), ... );
+  }
+};
+
+template <typename T, size_t N>
+struct EstrinEvaluator {
+  std::array<T,N> c;
+  constexpr T operator()( T x ) const { return POLYNOMIAL_DETAIL::estrin( c, x ); }
+  void operator()( const T* x, T* y, size_t n ) const {
+    for( size_t j=0; j < n; ++j ) y[j] = (*this)( x[j] );
+  }
+};
+
+template <typename T, size_t N>
+class Polynomial
+{
+  static_assert( N > 0, "Polynomial<T,N> needs at least one coefficient." );
+public:
+  constexpr Polynomial(): c{} {}
+  // Coefficients from x^0 up; missing ones are zero.
+  constexpr Polynomial( std::initializer_list<T> input ): c{} {
+    assert( input.size() <= N );
+    size_t i = 0;
+    for( T v : input ) c[i++] = v;
+  }
+  // From a run time polynomial of at most N coefficients.
+  explicit Polynomial( const Polynomial<T>& P ): c{} {
+    assert( P.size() <= N );
+    for( size_t i=0; i < P.size(); ++i ) c[i] = P.coefficient( i );
+  }
+  void RandomCoefficients( uint64_t seed ) { // same coefficients as Polynomial<T>(N)
+    Polynomial<T> P( N );
+    P.RandomCoefficients( seed );
+    *this = Polynomial( P );
+  }
+
+  static constexpr size_t size() { return N; }
+  constexpr T coefficient( size_t i ) const { return c[i]; }
+  constexpr T& coefficient( size_t i ) { return c[i]; }
+
+  constexpr T operator()( T x ) const { return horner()( x ); }
+  void evaluate( const T* x, T* y, size_t n ) const { horner()( x, y, n ); }
+  constexpr HornerEvaluator<T,N> horner() const { return { c }; }
+  constexpr EstrinEvaluator<T,N> estrin() const { return { c }; }
+
+  constexpr T Integral( T A, T B ) const {
+    std::array<T,N+1> P{};
+    for( size_t i=0; i < N; ++i ) P[i+1] = c[i]/T(i+1);
+    const HornerEvaluator<T,N+1> L{ P };
+    return L( B )-L( A );
+  }
+  template <typename U, size_t M>
+  friend std::ostream& operator<<( std::ostream& os, const Polynomial<U,M>& P );
+private:
+  std::array<T,N> c;
+};
+
+template <typename T, size_t N>
+std::ostream& operator<<( std::ostream& os, const Polynomial<T,N>& P )
+{
+  os << "P := [ ";
+  for( auto coeff : P.c ) { os << coeff << " "; }
+  return os << "] ";
+}
+
 #endif // POLYNOMIAL_H
@@ -0,0 +1,516 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : polynomial_arithmetic.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Arithmetic on Polynomial<T>: sum, difference, product, square,
+//        : division with remainder, composition and derivative.
+//
+// Products pick the algorithm by the size of the smaller factor:
+//   schoolbook  below KARATSUBA_THRESHOLD coefficients, O(n m)
+//   Karatsuba   3 half size products instead of 4, O(n^1.58); any ring,
+//               so also mpq_class and the other exact types
+//   FFT         floating point T from FFT_THRESHOLD: complex radix-2 FFT
+//               with both real factors packed in one transform, O(n log n).
+//               The error is about eps log(n) n max|a| max|b|, against
+//               eps n max|a| max|b| for the sums of the other two
+//   NTT         integer T from NTT_THRESHOLD: number theoretic transforms
+//               modulo three primes joined by the Chinese remainder
+//               theorem. Exact while n max|a| max|b| < 1.5e25, otherwise
+//               (and without __int128) Karatsuba
+// multiply_mod() is the exact product modulo any m < 2^32, on the same
+// three prime NTT (schoolbook for short factors).
+//
+// Division of exact types (integers, rationals) inverts the reversed
+// divisor as a power series by Newton iteration when quotient and divisor
+// are both long, which costs a few products. Floating point T always uses
+// long division: that series grows like |1/root|^k for roots of the divisor
+// inside the unit circle, and the cancellations of the Newton steps lose
+// far more of it than long division does. Signed integer T needs a divisor
+// whose leading coefficient is 1 or -1, unsigned T one whose leading
+// coefficient is 1. compose() splits the outer polynomial,
+// a(x) = lo(x) + x^h hi(x), and multiplies by the precomputed b^h, so it
+// runs on fast products too.
+//
+// Sizes are not trimmed: a product has n+m-1 coefficients even if leading
+// ones cancel. Only division looks for the true degrees.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYNOMIAL_ARITHMETIC_H
+#define POLYNOMIAL_ARITHMETIC_H
+
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include "polynomial.h"
+
+namespace POLYNOMIAL_ARITHMETIC {
+
+  // Crossovers measured with g++ -O2 on equal size factors (divisor and
+  // quotient for NEWTON_THRESHOLD); Karatsuba stays ahead of the plain
+  // radix-2 transforms up to several thousand coefficients.
+  constexpr size_t KARATSUBA_THRESHOLD = 32;
+  constexpr size_t FFT_THRESHOLD = 8192;
+  constexpr size_t NTT_THRESHOLD = 8192;
+  constexpr size_t MOD_NTT_THRESHOLD = 256;
+  constexpr size_t NEWTON_THRESHOLD = 8192;
+
+  // out[0..n+m-1) += a*b
+  template <typename T>
+  void schoolbook( const T* a, size_t n, const T* b, size_t m, T* out ) {
+    for( size_t i=0; i < n; ++i ) {
+      const T ai = a[i];
+      for( size_t j=0; j < m; ++j ) out[i+j] += ai*b[j];
+    }
+  }
+
+  // out[0..n+m-1) += a*b
+  template <typename T>
+  void karatsuba( const T* a, size_t n, const T* b, size_t m, T* out ) {
+    if( n < m ) { std::swap( a, b ); std::swap( n, m ); }
+    if( m < KARATSUBA_THRESHOLD ) return schoolbook( a, n, b, m, out );
+    if( 2*m <= n ) { // unbalanced: a in pieces of m
+      for( size_t i=0; i < n; i += m ) karatsuba( a+i, std::min( m, n-i ), b, m, out+i );
+      return;
+    }
+    // a = a0 + x^h a1, b = b0 + x^h b1, with h <= m
+    const size_t h = ( n+1 )/2, n1 = n-h, m1 = m-h;
+    if( m1 == 0 ) {
+      karatsuba( a, h, b, m, out );
+      karatsuba( a+h, n1, b, m, out+h );
+      return;
+    }
+    std::vector<T> sa( a, a+h ), sb( b, b+h );
+    for( size_t i=0; i < n1; ++i ) sa[i] += a[h+i];
+    for( size_t i=0; i < m1; ++i ) sb[i] += b[h+i];
+    std::vector<T> z0( 2*h-1, T(0) ), z1( 2*h-1, T(0) ), z2( n1+m1-1, T(0) );
+    karatsuba( a, h, b, h, z0.data() );
+    karatsuba( a+h, n1, b+h, m1, z2.data() );
+    karatsuba( sa.data(), h, sb.data(), h, z1.data() );
+    for( size_t i=0; i < z0.size(); ++i ) {
+      out[i] += z0[i];
+      out[h+i] += z1[i]-z0[i];
+    }
+    for( size_t i=0; i < z2.size(); ++i ) {
+      out[2*h+i] += z2[i];
+      out[h+i] -= z2[i];
+    }
+  }
+
+  // exp(-2 pi i k/N), k < N/2, for the largest N transformed so far by this
+  // thread; a transform of n points takes every N/n-th. Computing each root
+  // from its own angle avoids the error of repeated products, and caching
+  // them saves the sines and cosines that dominate short transforms.
+  template <typename T>
+  const std::vector< std::complex<T> >& roots( size_t n ) {
+    thread_local std::vector< std::complex<T> > w;
+    if( 2*w.size() < n ) {
+      const T PI = std::acos( T(-1) );
+      w.resize( n/2 );
+      for( size_t k=0; k < n/2; ++k ) w[k] = std::polar( T(1), -2*PI*T(k)/T(n) );
+    }
+    return w;
+  }
+
+  // In place radix-2 FFT of a power of two size; the inverse is scaled.
+  // Complex products are spelled out: operator* checks for infinities.
+  template <typename T>
+  void fft( std::vector< std::complex<T> >& a, bool inverse ) {
+    const size_t n = a.size();
+    for( size_t i=1, j=0; i < n; ++i ) {
+      size_t bit = n >> 1;
+      for( ; j & bit; bit >>= 1 ) j ^= bit;
+      j ^= bit;
+      if( i < j ) std::swap( a[i], a[j] );
+    }
+    const std::vector< std::complex<T> >& w = roots<T>( n );
+    const T sign = inverse ? -1 : 1;
+    for( size_t len=2; len <= n; len <<= 1 ) {
+      const size_t half = len/2, step = 2*w.size()/len;
+      for( size_t i=0; i < n; i += len )
+	for( size_t k=0; k < half; ++k ) {
+	  const std::complex<T> u = a[i+k], x = a[i+k+half], r( w[k*step].real(), sign*w[k*step].imag() );
+	  const std::complex<T> v( x.real()*r.real() - x.imag()*r.imag(), x.real()*r.imag() + x.imag()*r.real() );
+	  a[i+k] = u+v;
+	  a[i+k+half] = u-v;
+	}
+    }
+    if( inverse ) {
+      const T scale = T(1)/T(n);
+      for( auto& x : a ) x = std::complex<T>( x.real()*scale, x.imag()*scale );
+    }
+  }
+
+  // out[0..n+m-1) += a*b. c = a + i b is transformed once:
+  // A_k B_k = ( C_k^2 - conj(C_{-k})^2 )/(4i). Its rounding error scales
+  // with max(|a|,|b|)^2, so b is first brought to the magnitude of a by a
+  // power of two (exact), and the product scaled back.
+  template <typename T>
+  void fft_multiply( const T* a, size_t n, const T* b, size_t m, T* out ) {
+    size_t N = 1;
+    while( N < n+m-1 ) N <<= 1;
+    T max_a = 0, max_b = 0;
+    for( size_t i=0; i < n; ++i ) max_a = std::max( max_a, std::fabs( a[i] ) );
+    for( size_t i=0; i < m; ++i ) max_b = std::max( max_b, std::fabs( b[i] ) );
+    if( max_a == 0 || max_b == 0 || !std::isfinite( max_a*max_b ) ) return karatsuba( a, n, b, m, out );
+    const int shift = std::ilogb( max_a )-std::ilogb( max_b );
+    std::vector< std::complex<T> > c( N );
+    for( size_t i=0; i < n; ++i ) c[i].real( a[i] );
+    for( size_t i=0; i < m; ++i ) c[i].imag( std::ldexp( b[i], shift ) );
+    fft( c, false );
+    std::vector< std::complex<T> > p( N );
+    for( size_t k=0; k < N; ++k ) {
+      const std::complex<T> x = c[k], y = std::conj( c[( N-k ) & ( N-1 )] );
+      const T re = x.real()*x.real() - x.imag()*x.imag() - y.real()*y.real() + y.imag()*y.imag();
+      const T im = 2*( x.real()*x.imag() - y.real()*y.imag() );
+      p[k] = std::complex<T>( im/4, -re/4 ); // (re + i im)/(4i)
+    }
+    fft( p, true );
+    for( size_t i=0; i < n+m-1; ++i ) out[i] += std::ldexp( p[i].real(), -shift );
+  }
+
+  // Number theoretic transform modulo P = c 2^k + 1 with primitive root 3.
+  // The three primes take transforms of up to 2^23 points and their product
+  // M ~ 7.9e25 > 2^86 bounds what the Chinese remainder theorem recovers.
+  constexpr uint32_t P1 = 998244353, P2 = 167772161, P3 = 469762049;
+  constexpr size_t MAX_NTT = size_t(1) << 23;
+
+  constexpr uint64_t power_mod( uint64_t b, uint64_t e, uint64_t p ) {
+    uint64_t r = 1;
+    for( b %= p; e; e >>= 1, b = b*b % p ) if( e & 1 ) r = r*b % p;
+    return r;
+  }
+
+  // v mod p in [0, p), for signed v too.
+  template <typename T>
+  uint64_t residue( T v, uint64_t p ) {
+    if constexpr( std::is_signed_v<T> ) {
+      const long long r = static_cast<long long>( v ) % static_cast<long long>( p );
+      return static_cast<uint64_t>( ( r < 0 ) ? r + static_cast<long long>( p ) : r );
+    } else return static_cast<uint64_t>( v ) % p;
+  }
+
+  template <uint32_t P>
+  void ntt( std::vector<uint32_t>& a, bool inverse ) {
+    const size_t n = a.size();
+    assert( ( P-1 ) % n == 0 );
+    for( size_t i=1, j=0; i < n; ++i ) {
+      size_t bit = n >> 1;
+      for( ; j & bit; bit >>= 1 ) j ^= bit;
+      j ^= bit;
+      if( i < j ) std::swap( a[i], a[j] );
+    }
+    // Powers of an n-th root of unity; level len uses every n/len-th.
+    std::vector<uint32_t> w( std::max<size_t>( 1, n/2 ) );
+    uint64_t root = power_mod( 3, ( P-1 )/n, P );
+    if( inverse ) root = power_mod( root, P-2, P );
+    w[0] = 1;
+    for( size_t k=1; k < n/2; ++k ) w[k] = static_cast<uint32_t>( w[k-1]*root % P );
+    for( size_t len=2; len <= n; len <<= 1 ) {
+      const size_t half = len/2, step = n/len;
+      for( size_t i=0; i < n; i += len )
+	for( size_t k=0; k < half; ++k ) {
+	  const uint32_t u = a[i+k], v = static_cast<uint32_t>( uint64_t( a[i+k+half] )*w[k*step] % P );
+	  a[i+k] = ( u+v < P ) ? u+v : u+v-P;
+	  a[i+k+half] = ( u >= v ) ? u-v : u+P-v;
+	}
+    }
+    if( inverse ) {
+      const uint64_t scale = power_mod( n, P-2, P );
+      for( auto& x : a ) x = static_cast<uint32_t>( x*scale % P );
+    }
+  }
+
+  // a*b modulo P, n+m-1 residues.
+  template <uint32_t P, typename T>
+  std::vector<uint32_t> ntt_convolve( const std::vector<T>& a, const std::vector<T>& b ) {
+    const size_t size = a.size()+b.size()-1;
+    size_t N = 1;
+    while( N < size ) N <<= 1;
+    assert( N <= MAX_NTT );
+    std::vector<uint32_t> fa( N, 0 ), fb( N, 0 );
+    for( size_t i=0; i < a.size(); ++i ) fa[i] = static_cast<uint32_t>( residue( a[i], P ) );
+    for( size_t i=0; i < b.size(); ++i ) fb[i] = static_cast<uint32_t>( residue( b[i], P ) );
+    ntt<P>( fa, false );
+    ntt<P>( fb, false );
+    for( size_t i=0; i < N; ++i ) fa[i] = static_cast<uint32_t>( uint64_t( fa[i] )*fb[i] % P );
+    ntt<P>( fa, true );
+    fa.resize( size );
+    return fa;
+  }
+
+  // The x in [0, P1 P2 P3) with the given residues, as x12 + P1 P2 k.
+  inline void crt( uint32_t r1, uint32_t r2, uint32_t r3, uint64_t& x12, uint64_t& k ) {
+    constexpr uint64_t INV1 = power_mod( P1, P2-2, P2 );
+    constexpr uint64_t INV12 = power_mod( uint64_t( P1 )*P2 % P3, P3-2, P3 );
+    const uint64_t t = ( r2 + P2 - r1 % P2 ) % P2 * INV1 % P2;
+    x12 = r1 + uint64_t( P1 )*t;
+    k = ( r3 + P3 - x12 % P3 ) % P3 * INV12 % P3;
+  }
+
+#ifdef __SIZEOF_INT128__
+  // True when every coefficient of a*b fits the CRT range (signed: half of it).
+  template <typename T>
+  bool ntt_exact( const std::vector<T>& a, const std::vector<T>& b ) {
+    auto max_abs = []( const std::vector<T>& v ) {
+      long double r = 0;
+      for( T x : v ) r = std::max( r, std::fabs( static_cast<long double>( x ) ) );
+      return r;
+    };
+    const long double bound = static_cast<long double>( std::min( a.size(), b.size() ) )*max_abs( a )*max_abs( b );
+    return bound < 1.5e25L && a.size()+b.size()-1 <= MAX_NTT;
+  }
+
+  // out[0..n+m-1) += a*b, exactly.
+  template <typename T>
+  void ntt_multiply( const std::vector<T>& a, const std::vector<T>& b, T* out ) {
+    const std::vector<uint32_t> r1 = ntt_convolve<P1>( a, b ), r2 = ntt_convolve<P2>( a, b ), r3 = ntt_convolve<P3>( a, b );
+    const unsigned __int128 P12 = uint64_t( P1 )*P2, M = P12*P3;
+    for( size_t i=0; i < r1.size(); ++i ) {
+      uint64_t x12, k;
+      crt( r1[i], r2[i], r3[i], x12, k );
+      const unsigned __int128 x = x12 + P12*k;
+      if constexpr( std::is_signed_v<T> ) out[i] += static_cast<T>( ( x > M/2 ) ? -static_cast<__int128>( M-x ) : static_cast<__int128>( x ) );
+      else out[i] += static_cast<T>( x );
+    }
+  }
+#endif
+
+  template <typename T>
+  std::vector<T> multiply( const std::vector<T>& a, const std::vector<T>& b ) {
+    if( a.empty() || b.empty() ) return {};
+    std::vector<T> out( a.size()+b.size()-1, T(0) );
+    const size_t shorter = std::min( a.size(), b.size() );
+    if constexpr( std::is_floating_point_v<T> ) {
+      if( shorter >= FFT_THRESHOLD ) {
+	fft_multiply( a.data(), a.size(), b.data(), b.size(), out.data() );
+	return out;
+      }
+    }
+#ifdef __SIZEOF_INT128__
+    if constexpr( std::is_integral_v<T> ) {
+      if( shorter >= NTT_THRESHOLD && ntt_exact( a, b ) ) {
+	ntt_multiply( a, b, out.data() );
+	return out;
+      }
+    }
+#endif
+    karatsuba( a.data(), a.size(), b.data(), b.size(), out.data() );
+    return out;
+  }
+
+  // Short squares use each cross product once; longer ones are products.
+  template <typename T>
+  std::vector<T> square( const std::vector<T>& a ) {
+    if( a.size() >= KARATSUBA_THRESHOLD ) return multiply( a, a );
+    if( a.empty() ) return {};
+    std::vector<T> out( 2*a.size()-1, T(0) );
+    for( size_t i=0; i < a.size(); ++i )
+      for( size_t j=i+1; j < a.size(); ++j ) out[i+j] += a[i]*a[j];
+    for( size_t k=0; k < out.size(); ++k ) out[k] += out[k];
+    for( size_t i=0; i < a.size(); ++i ) out[2*i] += a[i]*a[i];
+    return out;
+  }
+
+  // Coefficients of a*b modulo mod, in [0, mod).
+  template <typename T>
+  std::vector<T> multiply_mod( const std::vector<T>& a, const std::vector<T>& b, uint32_t mod ) {
+    assert( mod > 0 );
+    if( a.empty() || b.empty() ) return {};
+    std::vector<uint64_t> ra( a.size() ), rb( b.size() );
+    for( size_t i=0; i < a.size(); ++i ) ra[i] = residue( a[i], mod );
+    for( size_t i=0; i < b.size(); ++i ) rb[i] = residue( b[i], mod );
+    std::vector<uint64_t> acc( a.size()+b.size()-1, 0 );
+    if( std::min( a.size(), b.size() ) < MOD_NTT_THRESHOLD ) {
+      for( size_t i=0; i < ra.size(); ++i )
+	for( size_t j=0; j < rb.size(); ++j ) acc[i+j] = ( acc[i+j] + ra[i]*rb[j] % mod ) % mod;
+    } else {
+      // Each coefficient is below min(n,m) mod^2 < 2^22 2^64 < P1 P2 P3.
+      const std::vector<uint32_t> r1 = ntt_convolve<P1>( ra, rb ), r2 = ntt_convolve<P2>( ra, rb ), r3 = ntt_convolve<P3>( ra, rb );
+      const uint64_t P12 = uint64_t( P1 )*P2 % mod;
+      for( size_t i=0; i < acc.size(); ++i ) {
+	uint64_t x12, k;
+	crt( r1[i], r2[i], r3[i], x12, k );
+	acc[i] = ( x12 % mod + P12*k % mod ) % mod;
+      }
+    }
+    return std::vector<T>( acc.begin(), acc.end() );
+  }
+
+  // g with f g = 1 mod x^k, by Newton: g <- g (2 - f g), doubling the
+  // correct terms each step. f[0] must be invertible in T.
+  template <typename T>
+  std::vector<T> inverse_series( const std::vector<T>& f, size_t k ) {
+    std::vector<T> g{ T(1)/f[0] };
+    for( size_t len=1; len < k; ) {
+      len = std::min( 2*len, k );
+      std::vector<T> e = multiply( std::vector<T>( f.begin(), f.begin()+std::min( len, f.size() ) ), g );
+      e.resize( len, T(0) );
+      for( auto& v : e ) v = -v;
+      e[0] += T(2);
+      g = multiply( g, e );
+      g.resize( len );
+    }
+    return g;
+  }
+
+  // a = q b + r with deg r < deg b; r has max(1, deg b) coefficients.
+  template <typename T>
+  std::pair< std::vector<T>, std::vector<T> > divide( const std::vector<T>& a, std::vector<T> b ) {
+    while( b.size() > 1 && b.back() == T(0) ) b.pop_back();
+    assert( !b.empty() && !( b.back() == T(0) ) );
+    // T(-1) of an unsigned T is its maximum, which integer division does not invert.
+    if constexpr( std::is_unsigned_v<T> ) assert( b.back() == T(1) );
+    else if constexpr( std::is_integral_v<T> ) assert( b.back() == T(1) || b.back() == T(-1) );
+    size_t n = a.size();
+    while( n > 1 && a[n-1] == T(0) ) --n;
+    const size_t m = b.size();
+    std::vector<T> r( std::max<size_t>( 1, m-1 ), T(0) );
+    if( n < m ) {
+      std::copy( a.begin(), a.begin()+n, r.begin() );
+      return { std::vector<T>{ T(0) }, r };
+    }
+    const size_t q_size = n-m+1;
+    std::vector<T> q( q_size, T(0) );
+    if( !std::is_floating_point_v<T> && std::min( q_size, m ) >= NEWTON_THRESHOLD ) {
+      // rev(q) = rev(a) / rev(b) mod x^q_size, rev(b)[0] the leading coefficient.
+      std::vector<T> ra( q_size ), rb( std::min( m, q_size ) );
+      for( size_t i=0; i < ra.size(); ++i ) ra[i] = a[n-1-i];
+      for( size_t i=0; i < rb.size(); ++i ) rb[i] = b[m-1-i];
+      const std::vector<T> rq = multiply( ra, inverse_series( rb, q_size ) );
+      for( size_t i=0; i < q_size; ++i ) q[i] = rq[q_size-1-i];
+      // Only the low m-1 terms of b q are needed for r = a - b q.
+      if( m > 1 ) {
+	const std::vector<T> bq = multiply( std::vector<T>( b.begin(), b.end()-1 ),
+					    std::vector<T>( q.begin(), q.begin()+std::min( q_size, m-1 ) ) );
+	for( size_t i=0; i < m-1; ++i ) r[i] = a[i]-bq[i];
+      }
+    } else {
+      std::vector<T> w( a.begin(), a.begin()+n );
+      for( size_t i=q_size; i-- > 0; ) {
+	const T c = w[i+m-1]/b[m-1];
+	q[i] = c;
+	for( size_t j=0; j < m; ++j ) w[i+j] -= c*b[j];
+      }
+      std::copy( w.begin(), w.begin()+( m-1 ), r.begin() );
+    }
+    return { q, r };
+  }
+
+  template <typename T>
+  void add_to( std::vector<T>& x, const std::vector<T>& y ) {
+    if( x.size() < y.size() ) x.resize( y.size(), T(0) );
+    for( size_t i=0; i < y.size(); ++i ) x[i] += y[i];
+  }
+
+  template <typename T>
+  void subtract_from( std::vector<T>& x, const std::vector<T>& y ) {
+    if( x.size() < y.size() ) x.resize( y.size(), T(0) );
+    for( size_t i=0; i < y.size(); ++i ) x[i] -= y[i];
+  }
+
+  // a[0..len)(b) = lo(b) + b^h hi(b), powers[k] = b^(2^k), h = 2^k < len.
+  template <typename T>
+  std::vector<T> compose( const T* a, size_t len, const std::vector< std::vector<T> >& powers ) {
+    if( len == 1 ) return { a[0] };
+    size_t k = 0;
+    while( ( size_t(2) << k ) < len ) ++k;
+    const size_t h = size_t(1) << k;
+    std::vector<T> retval = compose( a, h, powers );
+    add_to( retval, multiply( powers[k], compose( a+h, len-h, powers ) ) );
+    return retval;
+  }
+
+  template <typename T>
+  std::vector<T> compose( const std::vector<T>& a, const std::vector<T>& b ) {
+    if( a.empty() ) return { T(0) };
+    if( a.size() == 1 || b.empty() ) return { a[0] };
+    std::vector< std::vector<T> > powers{ b };
+    while( ( size_t(2) << ( powers.size()-1 ) ) < a.size() ) powers.push_back( square( powers.back() ) );
+    return compose( a.data(), a.size(), powers );
+  }
+
+  template <typename T>
+  std::vector<T> derivative( const std::vector<T>& a ) {
+    std::vector<T> retval( ( a.size() > 1 ) ? a.size()-1 : 1, T(0) );
+    for( size_t i=1; i < a.size(); ++i ) retval[i-1] = a[i]*T(i);
+    return retval;
+  }
+
+} // end of namespace POLYNOMIAL_ARITHMETIC
+
+template <typename T>
+Polynomial<T> operator+( const Polynomial<T>& a, const Polynomial<T>& b )
+{
+  std::vector<T> c = a.coefficients();
+  POLYNOMIAL_ARITHMETIC::add_to( c, b.coefficients() );
+  return Polynomial<T>( std::move( c ) );
+}
+
+template <typename T>
+Polynomial<T> operator-( const Polynomial<T>& a, const Polynomial<T>& b )
+{
+  std::vector<T> c = a.coefficients();
+  POLYNOMIAL_ARITHMETIC::subtract_from( c, b.coefficients() );
+  return Polynomial<T>( std::move( c ) );
+}
+
+template <typename T>
+Polynomial<T> operator-( const Polynomial<T>& a )
+{
+  std::vector<T> c( a.size(), T(0) );
+  POLYNOMIAL_ARITHMETIC::subtract_from( c, a.coefficients() );
+  return Polynomial<T>( std::move( c ) );
+}
+
+template <typename T>
+Polynomial<T> operator*( const Polynomial<T>& a, const Polynomial<T>& b )
+{
+  return Polynomial<T>( POLYNOMIAL_ARITHMETIC::multiply( a.coefficients(), b.coefficients() ) );
+}
+
+template <typename T>
+Polynomial<T> square( const Polynomial<T>& a )
+{
+  return Polynomial<T>( POLYNOMIAL_ARITHMETIC::square( a.coefficients() ) );
+}
+
+// Exact a*b with coefficients reduced to [0, m), m < 2^32.
+template <typename T>
+Polynomial<T> multiply_mod( const Polynomial<T>& a, const Polynomial<T>& b, uint32_t m )
+{
+  static_assert( std::is_integral_v<T>, "multiply_mod needs integer coefficients." );
+  return Polynomial<T>( POLYNOMIAL_ARITHMETIC::multiply_mod( a.coefficients(), b.coefficients(), m ) );
+}
+
+// { quotient, remainder }
+template <typename T>
+std::pair< Polynomial<T>, Polynomial<T> > divide( const Polynomial<T>& a, const Polynomial<T>& b )
+{
+  auto qr = POLYNOMIAL_ARITHMETIC::divide( a.coefficients(), b.coefficients() );
+  return { Polynomial<T>( std::move( qr.first ) ), Polynomial<T>( std::move( qr.second ) ) };
+}
+
+template <typename T>
+Polynomial<T> operator/( const Polynomial<T>& a, const Polynomial<T>& b ) { return divide( a, b ).first; }
+
+template <typename T>
+Polynomial<T> operator%( const Polynomial<T>& a, const Polynomial<T>& b ) { return divide( a, b ).second; }
+
+// a( b(x) )
+template <typename T>
+Polynomial<T> compose( const Polynomial<T>& a, const Polynomial<T>& b )
+{
+  return Polynomial<T>( POLYNOMIAL_ARITHMETIC::compose( a.coefficients(), b.coefficients() ) );
+}
+
+template <typename T>
+Polynomial<T> derivative( const Polynomial<T>& a )
+{
+  return Polynomial<T>( POLYNOMIAL_ARITHMETIC::derivative( a.coefficients() ) );
+}
+
+#endif // POLYNOMIAL_ARITHMETIC_H
@@ -0,0 +1,145 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : polynomial_simd.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Bulk polynomial evaluation on SIMD lanes with run time dispatch
+//
+// evaluate( c, K, x, y, n ) sets y[j] = sum_i c[i] x[j]^i for K coefficients.
+// Each vector of points is evaluated with Estrin's scheme: pairs
+// c[2i] + c[2i+1] x, then pairs of those with x^2, x^4, .., so a level's
+// multiply-adds are independent and fill the pipeline, where Horner is one
+// chain of K-1 dependent ones.
+//
+// The lanes are GCC/Clang vector types; one generic kernel is compiled
+// three times, for AVX-512 (8 doubles), AVX2+FMA (4) and a 2 lane baseline
+// (SSE2 on x86-64), the first two through target attributes, so the binary
+// needs no -march and the widest kernel the CPU supports is picked when
+// first called (best()). Other compilers get a scalar kernel. Results agree
+// with Horner to rounding (FMA and a different association), not bitwise.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef POLYNOMIAL_SIMD_H
+#define POLYNOMIAL_SIMD_H
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+#if ( defined(__GNUC__) || defined(__clang__) ) && ( defined(__x86_64__) || defined(__i386__) )
+#define POLYNOMIAL_SIMD_X86 1
+#endif
+
+namespace POLYNOMIAL_SIMD {
+
+  enum class ISA { SCALAR, AVX2, AVX512 };
+
+  inline const char* name( ISA isa ) {
+    switch( isa ) {
+    case ISA::AVX512: return "avx512";
+    case ISA::AVX2:   return "avx2";
+    default:          return "scalar";
+    }
+  }
+
+  inline bool supported( ISA isa ) {
+#ifdef POLYNOMIAL_SIMD_X86
+    __builtin_cpu_init();
+    if( isa == ISA::AVX512 ) return __builtin_cpu_supports( "avx512f" );
+    if( isa == ISA::AVX2 ) return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" );
+#endif
+    return isa == ISA::SCALAR;
+  }
+
+  // Widest supported kernel, detected once.
+  inline ISA best() {
+    static const ISA isa = supported( ISA::AVX512 ) ? ISA::AVX512 : supported( ISA::AVX2 ) ? ISA::AVX2 : ISA::SCALAR;
+    return isa;
+  }
+
+  // Estrin keeps ceil(K/2) partial sums per vector; longer polynomials use Horner.
+  constexpr size_t MAX_ESTRIN = 64;
+
+  namespace DETAIL {
+    // W points at a time in V (a vector type of W elements of T, or T itself).
+    template <typename T, typename V, size_t W>
+    void estrin( const T* c, size_t K, const T* x, T* y, size_t n ) {
+      V t[MAX_ESTRIN/2];
+      T xin[W], yout[W];
+      for( size_t j=0; j < n; j += W ) {
+	const size_t m = std::min( W, n-j );
+	const T* xp = x+j;
+	if( m < W ) { // tail: pad with zeros
+	  std::fill( xin, xin+W, T(0) );
+	  std::copy( x+j, x+j+m, xin );
+	  xp = xin;
+	}
+	V p, r;
+	std::memcpy( &p, xp, sizeof(V) );
+	if( K > MAX_ESTRIN ) {
+	  r = p*T(0) + c[K-1];
+	  for( size_t i=K-1; i-- > 0; ) r = r*p + c[i];
+	} else {
+	  size_t h = K/2;
+	  for( size_t i=0; i < h; ++i ) t[i] = p*c[2*i+1] + c[2*i];
+	  if( K & 1 ) t[h++] = p*T(0) + c[K-1];
+	  while( h > 1 ) {
+	    p = p*p;
+	    const size_t half = h/2;
+	    for( size_t i=0; i < half; ++i ) t[i] = t[2*i+1]*p + t[2*i];
+	    if( h & 1 ) t[half] = t[h-1];
+	    h = ( h+1 )/2;
+	  }
+	  r = t[0];
+	}
+	if( m < W ) {
+	  std::memcpy( yout, &r, sizeof(V) );
+	  std::copy( yout, yout+m, y+j );
+	} else std::memcpy( y+j, &r, sizeof(V) );
+      }
+    }
+
+#if defined(__GNUC__) || defined(__clang__)
+    // Baseline: 2 lanes, SSE2 on x86-64, lowered to scalar code elsewhere.
+    typedef double V2D __attribute__(( vector_size(16), aligned(8) ));
+    inline void estrin_baseline( const double* c, size_t K, const double* x, double* y, size_t n ) {
+      estrin<double, V2D, 2>( c, K, x, y, n );
+    }
+#else
+    inline void estrin_baseline( const double* c, size_t K, const double* x, double* y, size_t n ) {
+      estrin<double, double, 1>( c, K, x, y, n );
+    }
+#endif
+
+#ifdef POLYNOMIAL_SIMD_X86
+    typedef double V4D __attribute__(( vector_size(32), aligned(8) ));
+    typedef double V8D __attribute__(( vector_size(64), aligned(8) ));
+
+    __attribute__(( target("avx2,fma"), flatten ))
+    inline void estrin_avx2( const double* c, size_t K, const double* x, double* y, size_t n ) {
+      estrin<double, V4D, 4>( c, K, x, y, n );
+    }
+    __attribute__(( target("avx512f"), flatten ))
+    inline void estrin_avx512( const double* c, size_t K, const double* x, double* y, size_t n ) {
+      estrin<double, V8D, 8>( c, K, x, y, n );
+    }
+#endif
+  }
+
+  // y[j] = polynomial with coefficients c[0..K) at x[j], j < n.
+  template <typename T>
+  void evaluate( const T* c, size_t K, const T* x, T* y, size_t n ) {
+    if( K == 0 ) { std::fill( y, y+n, T(0) ); return; }
+    DETAIL::estrin<T, T, 1>( c, K, x, y, n );
+  }
+  inline void evaluate( const double* c, size_t K, const double* x, double* y, size_t n, ISA isa = best() ) {
+    if( K == 0 ) { std::fill( y, y+n, 0.0 ); return; }
+#ifdef POLYNOMIAL_SIMD_X86
+    if( isa == ISA::AVX512 ) return DETAIL::estrin_avx512( c, K, x, y, n );
+    if( isa == ISA::AVX2 ) return DETAIL::estrin_avx2( c, K, x, y, n );
+#endif
+    (void)isa;
+    DETAIL::estrin_baseline( c, K, x, y, n );
+  }
+
+} // end of namespace POLYNOMIAL_SIMD
+
+#endif // POLYNOMIAL_SIMD_H
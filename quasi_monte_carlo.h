@@ -0,0 +1,271 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : quasi_monte_carlo.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: d-dimensional (quasi) Monte Carlo integration over a box with
+//        : pluggable point sets and randomized replicates.
+//
+// Point sets (make_point_set):
+// PSEUDO_RANDOM : Philox uniforms, the O(N^-1/2) baseline
+// SOBOL         : Sobol' sequence, Joe-Kuo direction numbers (up to 21
+//               : dimensions), nested uniform (Owen) scrambling done with
+//               : the hash based permutation of Laine-Karras / Burley
+// HALTON        : radical inverses in the first d primes, random shift
+// LATTICE       : extensible rank-1 lattice in radical inverse order with the
+//               : generating vector of Cools, Kuo and Nuyens (n up to 2^20),
+//               : random shift
+//
+// Every randomized point set is uniformly distributed on the unit cube, so
+// each replicate is an unbiased estimate; integrate() runs R independent
+// replicates and reports their mean and standard error. For smooth
+// integrands the scrambled/shifted low discrepancy sets converge close to
+// O(N^-1), so the same error needs far fewer points than PSEUDO_RANDOM.
+// Sobol and lattice points are best used in powers of two.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef QUASI_MONTE_CARLO_H
+#define QUASI_MONTE_CARLO_H
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "philox.h"
+#include "checkpoint.h"
+
+namespace MonteCarloIntegration {
+
+  enum class POINT_SET { PSEUDO_RANDOM, SOBOL, HALTON, LATTICE };
+
+  inline const char* name( POINT_SET kind ) {
+    switch( kind ) {
+    case POINT_SET::SOBOL:   return "sobol";
+    case POINT_SET::HALTON:  return "halton";
+    case POINT_SET::LATTICE: return "lattice";
+    default:                 return "pseudo-random";
+    }
+  }
+
+  // One randomization of a point set in [0,1)^d.
+  class PointSet
+  {
+  public:
+    explicit PointSet( unsigned int D ): d{D} {}
+    virtual ~PointSet() = default;
+    unsigned int dimension() const { return d; }
+    // Points first..first+n-1, row major: u[p*d+j] is coordinate j of point p.
+    virtual void generate( uint64_t first, size_t n, double* u ) const = 0;
+  protected:
+    const unsigned int d;
+  };
+
+  class PseudoRandomPoints : public PointSet
+  {
+  public:
+    PseudoRandomPoints( unsigned int D, uint64_t Seed ): PointSet{D}, rng{ Seed, 0 } {}
+    void generate( uint64_t first, size_t n, double* u ) const override {
+      const uint64_t H = ( d+1 )/2; // counters per point
+      for( size_t p=0; p < n; ++p ) {
+	for( uint64_t h=0; h < H; ++h ) {
+	  const auto pair = rng.uniform_pair( ( first+p )*H + h );
+	  u[p*d + 2*h] = pair.first;
+	  if( 2*h+1 < d ) u[p*d + 2*h+1] = pair.second;
+	}
+      }
+    }
+  private:
+    PhiloxStream rng;
+  };
+
+  inline uint32_t reverse_bits( uint32_t x ) {
+    x = ( ( x >> 1 ) & 0x55555555u ) | ( ( x & 0x55555555u ) << 1 );
+    x = ( ( x >> 2 ) & 0x33333333u ) | ( ( x & 0x33333333u ) << 2 );
+    x = ( ( x >> 4 ) & 0x0F0F0F0Fu ) | ( ( x & 0x0F0F0F0Fu ) << 4 );
+    x = ( ( x >> 8 ) & 0x00FF00FFu ) | ( ( x & 0x00FF00FFu ) << 8 );
+    return ( x >> 16 ) | ( x << 16 );
+  }
+
+  class SobolPoints : public PointSet
+  {
+  public:
+    static constexpr unsigned int MAX_DIMENSION = 21;
+
+    SobolPoints( unsigned int D, uint64_t Seed ): PointSet{D}, direction( D*BITS ), scramble( D ) {
+      assert( D >= 1 && D <= MAX_DIMENSION );
+      for( unsigned int j=0; j < d; ++j ) {
+	uint32_t* v = &direction[j*BITS];
+	if( j == 0 ) {
+	  for( unsigned int k=0; k < BITS; ++k ) v[k] = 1u << ( 31-k );
+	} else {
+	  const JoeKuo& p = JOE_KUO[j-1];
+	  for( unsigned int k=0; k < p.s; ++k ) v[k] = p.m[k] << ( 31-k );
+	  for( unsigned int k=p.s; k < BITS; ++k ) {
+	    v[k] = v[k-p.s] ^ ( v[k-p.s] >> p.s );
+	    for( unsigned int l=1; l < p.s; ++l )
+	      if( ( p.a >> ( p.s-1-l ) ) & 1 ) v[k] ^= v[k-l];
+	  }
+	}
+	scramble[j] = static_cast<uint32_t>( CHECKPOINT::item_seed( Seed, j ) );
+      }
+    }
+    void generate( uint64_t first, size_t n, double* u ) const override {
+      for( size_t p=0; p < n; ++p ) {
+	const uint64_t i = first+p;
+	assert( i < ( 1ull << BITS ) );
+	for( unsigned int j=0; j < d; ++j ) {
+	  const uint32_t* v = &direction[j*BITS];
+	  uint32_t x = 0;
+	  for( uint64_t b=i, k=0; b; b >>= 1, ++k ) if( b & 1 ) x ^= v[k];
+	  u[p*d+j] = ( owen_scramble( x, scramble[j] ) + 0.5 )*0x1p-32;
+	}
+      }
+    }
+  private:
+    static constexpr unsigned int BITS = 32;
+    struct JoeKuo { unsigned int s, a; uint32_t m[7]; };
+    // new-joe-kuo-6.21201, dimensions 2..21
+    static constexpr JoeKuo JOE_KUO[MAX_DIMENSION-1] = {
+      {1, 0, {1}},               {2, 1, {1,3}},             {3, 1, {1,3,1}},
+      {3, 2, {1,1,1}},           {4, 1, {1,1,3,3}},         {4, 4, {1,3,5,13}},
+      {5, 2, {1,1,5,5,17}},      {5, 4, {1,1,5,5,5}},       {5, 7, {1,1,7,11,19}},
+      {5, 11, {1,1,5,1,1}},      {5, 13, {1,1,1,3,11}},     {5, 14, {1,3,5,5,31}},
+      {6, 1, {1,3,3,9,7,49}},    {6, 13, {1,1,1,15,21,21}}, {6, 16, {1,3,1,13,27,49}},
+      {6, 19, {1,1,1,15,7,5}},   {6, 22, {1,3,1,15,13,25}}, {6, 25, {1,1,5,5,19,61}},
+      {7, 1, {1,3,7,11,23,15,103}}, {7, 4, {1,3,7,13,13,15,69}}
+    };
+    // Nested uniform scramble of the binary digits: a hash that only lets
+    // each bit depend on the bits above it, applied to the reversed value.
+    static uint32_t owen_scramble( uint32_t x, uint32_t seed ) {
+      x = reverse_bits( x );
+      x += seed;
+      x ^= x*0x6c50b47cu;
+      x ^= x*0xb82f1e52u;
+      x ^= x*0xc7afe638u;
+      x ^= x*0x8d22f6e6u;
+      return reverse_bits( x );
+    }
+
+    std::vector<uint32_t> direction; // d x BITS
+    std::vector<uint32_t> scramble;
+  };
+
+  // Uniform random shift modulo 1 (Cranley-Patterson rotation).
+  class ShiftedPoints : public PointSet
+  {
+  public:
+    ShiftedPoints( unsigned int D, uint64_t Seed ): PointSet{D}, shift( D ) {
+      const PhiloxStream rng( Seed, 1 );
+      for( unsigned int j=0; j < d; ++j ) shift[j] = rng.uniform_pair( j ).first;
+    }
+  protected:
+    double wrap( double x, unsigned int j ) const {
+      x += shift[j];
+      return ( x >= 1.0 ) ? x-1.0 : x;
+    }
+    std::vector<double> shift;
+  };
+
+  class HaltonPoints : public ShiftedPoints
+  {
+  public:
+    HaltonPoints( unsigned int D, uint64_t Seed ): ShiftedPoints{D, Seed} {
+      for( unsigned int p=2; base.size() < d; ++p ) {
+	bool prime = true;
+	for( unsigned int q : base ) if( p % q == 0 ) { prime = false; break; }
+	if( prime ) base.push_back( p );
+      }
+    }
+    void generate( uint64_t first, size_t n, double* u ) const override {
+      for( size_t p=0; p < n; ++p ) {
+	for( unsigned int j=0; j < d; ++j ) {
+	  const unsigned int b = base[j];
+	  double x = 0, f = 1.0/b;
+	  for( uint64_t i=first+p; i; i /= b, f /= b ) x += f*( i % b );
+	  u[p*d+j] = wrap( x, j );
+	}
+      }
+    }
+  private:
+    std::vector<unsigned int> base;
+  };
+
+  class LatticePoints : public ShiftedPoints
+  {
+  public:
+    static constexpr unsigned int MAX_DIMENSION = 20;
+
+    LatticePoints( unsigned int D, uint64_t Seed ): ShiftedPoints{D, Seed} {
+      assert( D >= 1 && D <= MAX_DIMENSION );
+    }
+    // Point i = frac( phi_2(i) z + shift ), phi_2 the base 2 radical inverse,
+    // so the first 2^m points are the 2^m point lattice with vector z.
+    void generate( uint64_t first, size_t n, double* u ) const override {
+      for( size_t p=0; p < n; ++p ) {
+	assert( first+p < ( 1ull << 32 ) );
+	const double phi = reverse_bits( static_cast<uint32_t>( first+p ) )*0x1p-32;
+	for( unsigned int j=0; j < d; ++j ) {
+	  const double x = phi*Z[j];
+	  u[p*d+j] = wrap( x-std::floor( x ), j );
+	}
+      }
+    }
+  private:
+    // lattice-39102-1024-1048576.3600 (Cools, Kuo, Nuyens)
+    static constexpr uint32_t Z[MAX_DIMENSION] = {
+      1, 182667, 469891, 498753, 110745, 446247, 250185, 118627, 245333, 283199,
+      408519, 391023, 246327, 126539, 399185, 461527, 300343, 69681, 516695, 436179
+    };
+  };
+
+  inline std::unique_ptr<PointSet> make_point_set( POINT_SET kind, unsigned int d, uint64_t seed ) {
+    switch( kind ) {
+    case POINT_SET::SOBOL:   return std::make_unique<SobolPoints>( d, seed );
+    case POINT_SET::HALTON:  return std::make_unique<HaltonPoints>( d, seed );
+    case POINT_SET::LATTICE: return std::make_unique<LatticePoints>( d, seed );
+    default:                 return std::make_unique<PseudoRandomPoints>( d, seed );
+    }
+  }
+
+  struct QMCResult {
+    double estimate;   // mean of the replicates
+    double std_error;  // standard error of that mean
+    unsigned int replicates;
+    uint64_t points;   // per replicate
+  };
+
+  // Integral of f over the box [lower,upper]; f( const double* x ) gets a
+  // point of dimension lower.size(). R replicates of N points, replicate r
+  // randomized from (Seed,r).
+  template <typename F>
+  QMCResult integrate( const F& f, const std::vector<double>& lower, const std::vector<double>& upper,
+		       POINT_SET kind, uint64_t N, unsigned int R = 16, uint64_t Seed = 1 ) {
+    assert( lower.size() == upper.size() && !lower.empty() && N > 0 && R > 1 );
+    const unsigned int d = static_cast<unsigned int>( lower.size() );
+    double volume = 1;
+    for( unsigned int j=0; j < d; ++j ) volume *= upper[j]-lower[j];
+    constexpr size_t BLOCK = 256;
+    std::vector<double> u( BLOCK*d );
+    std::vector<double> estimates( R );
+    for( unsigned int r=0; r < R; ++r ) {
+      const std::unique_ptr<PointSet> points = make_point_set( kind, d, CHECKPOINT::item_seed( Seed, r ) );
+      double total = 0;
+      for( uint64_t first=0; first < N; first += BLOCK ) {
+	const size_t n = static_cast<size_t>( std::min<uint64_t>( BLOCK, N-first ) );
+	points->generate( first, n, u.data() );
+	for( size_t p=0; p < n; ++p ) {
+	  double* x = &u[p*d];
+	  for( unsigned int j=0; j < d; ++j ) x[j] = lower[j] + ( upper[j]-lower[j] )*x[j];
+	  total += f( static_cast<const double*>( x ) );
+	}
+      }
+      estimates[r] = volume*total/N;
+    }
+    double mean = 0, variance = 0;
+    for( double e : estimates ) mean += e/R;
+    for( double e : estimates ) variance += ( e-mean )*( e-mean )/( R-1 );
+    return QMCResult{ mean, std::sqrt( variance/R ), R, N };
+  }
+
+} // end of namespace MonteCarloIntegration
+
+#endif // QUASI_MONTE_CARLO_H
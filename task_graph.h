@@ -0,0 +1,139 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : task_graph.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Dependency DAG of tasks executed on THREAD_POOL::ThreadPool
+//
+// Build the graph once (add() nodes, precede() edges), then run() it as often
+// as needed. Each node carries an atomic count of unfinished predecessors,
+// reset from its in-degree at the start of every run; the task that drops a
+// count to zero releases the successor. One released successor is run inline
+// by the finishing task, the rest go to the pool, so straight chains of
+// stages do not round trip through the queues.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "threadpool.h"
+#include <initializer_list>
+
+#pragma once
+
+namespace THREAD_POOL {
+
+  class TaskGraph {
+  public:
+    using NODE = size_t;
+
+    TaskGraph() = default;
+    TaskGraph( const TaskGraph& ) = delete;
+    TaskGraph& operator=( const TaskGraph& ) = delete;
+
+    // The callable is kept and invoked once per run().
+    template <typename F>
+    NODE add( F&& f, std::initializer_list<NODE> predecessors = {} ) {
+      nodes.emplace_back( new Node( Task( std::forward<F>( f ) ) ) );
+      const NODE id = nodes.size()-1;
+      for( NODE p : predecessors ) precede( p, id );
+      return id;
+    }
+    // before must finish before after starts.
+    void precede( NODE before, NODE after ) {
+      assert( before < nodes.size() && after < nodes.size() && before != after );
+      nodes[before]->successors.push_back( after );
+      nodes[after]->in_degree++;
+      validated = false;
+    }
+    size_t size() const { return nodes.size(); }
+
+    // Runs every node once and returns when all have finished; the calling
+    // thread helps execute. The first exception thrown by a node is rethrown
+    // here; nodes downstream of a failure are skipped. One run at a time.
+    void run( ThreadPool& pool );
+  private:
+    struct Node {
+      explicit Node( Task&& W ): work{ std::move( W ) } {}
+      Task work;
+      std::vector<NODE> successors;
+      unsigned int in_degree = 0;
+      std::atomic<unsigned int> remaining{0};
+      std::atomic<bool> failed{false}; // published by the remaining release
+    };
+    bool acyclic() const;
+    void schedule( ThreadPool& pool, NODE id ) {
+      pool.add( [this, &pool, id]() { execute( pool, id ); } );
+    }
+    void execute( ThreadPool& pool, NODE id );
+
+    std::vector< std::unique_ptr<Node> > nodes;
+    std::atomic<size_t> pending{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    bool validated = true;
+  };
+
+  // Kahn's algorithm on the in-degrees; a cycle would never release.
+  inline bool TaskGraph::acyclic() const
+  {
+    std::vector<unsigned int> degree( nodes.size() );
+    std::vector<NODE> ready;
+    for( NODE i=0; i < nodes.size(); ++i ) {
+      degree[i] = nodes[i]->in_degree;
+      if( degree[i] == 0 ) ready.push_back( i );
+    }
+    size_t visited = 0;
+    while( !ready.empty() ) {
+      NODE n = ready.back();
+      ready.pop_back();
+      ++visited;
+      for( NODE s : nodes[n]->successors ) if( --degree[s] == 0 ) ready.push_back( s );
+    }
+    return visited == nodes.size();
+  }
+
+  inline void TaskGraph::run( ThreadPool& pool )
+  {
+    if( nodes.empty() ) return;
+    if( !validated ) {
+      assert( acyclic() && "TaskGraph has a cycle." );
+      validated = true;
+    }
+    for( auto& n : nodes ) {
+      n->remaining.store( n->in_degree, std::memory_order_relaxed );
+      n->failed.store( false, std::memory_order_relaxed );
+    }
+    error = nullptr;
+    pending.store( nodes.size() );
+    for( NODE i=0; i < nodes.size(); ++i ) {
+      if( nodes[i]->in_degree == 0 ) schedule( pool, i );
+    }
+    pool.help_while( [this]() { return pending.load( std::memory_order_acquire ) != 0; } );
+    if( error ) std::rethrow_exception( error );
+  }
+
+  inline void TaskGraph::execute( ThreadPool& pool, NODE id )
+  {
+    while( true ) {
+      Node& node = *nodes[id];
+      if( !node.failed.load( std::memory_order_relaxed ) ) {
+	try {
+	  node.work();
+	} catch( ... ) {
+	  node.failed.store( true, std::memory_order_relaxed );
+	  std::unique_lock<std::mutex> lock{ error_mutex };
+	  if( !error ) error = std::current_exception();
+	}
+      }
+      NODE next = nodes.size();
+      for( NODE s : node.successors ) {
+	Node& successor = *nodes[s];
+	if( node.failed.load( std::memory_order_relaxed ) ) successor.failed.store( true, std::memory_order_relaxed );
+	if( successor.remaining.fetch_sub( 1, std::memory_order_acq_rel ) != 1 ) continue;
+	if( next == nodes.size() ) next = s;
+	else schedule( pool, s );
+      }
+      // Last touch of this node; run() may return once pending reaches zero.
+      pending.fetch_sub( 1, std::memory_order_release );
+      if( next == nodes.size() ) return;
+      id = next;
+    }
+  }
+
+} // end of namespace THREAD_POOL
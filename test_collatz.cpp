@@ -0,0 +1,139 @@
+// test_collatz.cpp
+// Unit test for CollatzRangeEngine.
+// count() must agree with collatz_count for jump sizes K from 1 to 20, with
+// the smallest memo each allows, below and above the memo and at starts near
+// 2^64 where the jump table gives way to collatz_count. search_block() and
+// search() must find the brute force maximum (ties to the smaller start) of
+// ranges that do not start at 1, with block edges falling anywhere in the
+// 6j+4 and merging residue sieve. collatz_count must match the GMP
+// reference where trajectories climb past 2^64 (128 bit stage) and past
+// (2^128-2)/3 (GMP fallback).
+// g++ -O2 -Wall -std=c++17 test_collatz.cpp -o test_collatz -pthread -lgmpxx -lgmp
+
+#include "collatz_range.h"
+#include <cassert>
+#include <iostream>
+
+using namespace THREAD_POOL;
+
+// Longest trajectory in [lo,hi), one start at a time.
+static CollatzRecord BruteForce( unsigned long long lo, unsigned long long hi )
+{
+    CollatzRecord retval{ lo, 0 };
+    for( unsigned long long n=lo; n < hi; ++n ) {
+	const unsigned int terms = collatz_count( n );
+	if( terms > retval.count ) retval = CollatzRecord{ n, terms };
+    }
+    return retval;
+}
+
+static bool Same( const CollatzRecord& a, const CollatzRecord& b )
+{
+    return a.NUM == b.NUM && a.count == b.count;
+}
+
+// Largest value on the trajectory of n.
+static mpz_class Peak( mpz_class n )
+{
+    mpz_class retval = n;
+    while( n != 1 ) {
+	if( mpz_even_p( n.get_mpz_t() ) ) n >>= 1;
+	else n = 3*n+1;
+	if( n > retval ) retval = n;
+    }
+    return retval;
+}
+
+static void TestWide()
+{
+    assert( collatz_mpz( ~0ull ) == mpz_class( "18446744073709551615" ) );
+    // Odd starts just below 2^64 leave 64 bits on the first step; the path
+    // record 1980976057694848447 peaks at 126 bits (6.4e37).
+    for( unsigned long long i=0; i < 200; ++i ) {
+	const unsigned long long n = ~0ull - 2*i;
+	assert( collatz_count( n ) == collatz_count_gmp( collatz_mpz( n ) ) );
+    }
+    const unsigned long long record = 1980976057694848447ull;
+    assert( mpz_sizeinbase( Peak( collatz_mpz( record ) ).get_mpz_t(), 2 ) == 126 );
+    assert( collatz_count( record ) == collatz_count_gmp( collatz_mpz( record ) ) );
+#ifdef __SIZEOF_INT128__
+    using u128 = unsigned __int128;
+    const u128 MAX128 = ( ~u128(0)-1 )/3;
+    assert( collatz_mpz( ~u128(0) ) == mpz_class( "340282366920938463463374607431768211455" ) );
+    // Odd starts around (2^128-2)/3: below it the first odd step goes past it.
+    unsigned int to_gmp = 0;
+    for( u128 w = MAX128-400; w < MAX128+400; ++w ) {
+	const mpz_class W = collatz_mpz( w );
+	assert( collatz_count_u128( w ) == collatz_count_gmp( W ) );
+	if( Peak( W ) > collatz_mpz( MAX128 ) ) ++to_gmp;
+    }
+    assert( to_gmp > 400 );
+    // Starts of 65 to 127 bits, including even ones.
+    for( unsigned int bits=65; bits < 128; ++bits ) {
+	const u128 w = ( u128(1) << bits ) + 12345*bits;
+	assert( collatz_count_u128( w ) == collatz_count_gmp( collatz_mpz( w ) ) );
+    }
+#endif
+}
+
+static void TestCount()
+{
+    for( unsigned int K : { 1, 2, 5, 8, 13, 16, 20 } ) {
+	const CollatzRangeEngine engine( K, 0 ); // memo of 2^(K+1): most counts go through the jump table
+	assert( engine.jump_bits() == K && engine.cache_size() == ( size_t(1) << ( K+1 ) ) );
+	for( unsigned long long n=1; n < 20000; ++n ) assert( engine.count( n ) == unsigned( collatz_count( n ) ) );
+	for( unsigned long long lo : { 1ull << 21, 10000000019ull, 1ull << 40, 123456789012345ull, ~0ull - 5000 } )
+	    for( unsigned long long n=lo; n < lo+5000; ++n ) assert( engine.count( n ) == unsigned( collatz_count( n ) ) );
+    }
+}
+
+static void TestSearchBlock()
+{
+    for( unsigned int K : { 2, 4, 8, 12, 16 } ) {
+	const CollatzRangeEngine engine( K, 0 );
+	// Edges at every residue mod 6 and mod 2^K, and blocks shorter than the sieve's reach.
+	for( unsigned long long lo : { 1ull, 2ull, 27ull, 1000003ull, 10000000000ull, 10000000007ull, ( 1ull << 33 ) - 5 } )
+	    for( unsigned long long len : { 1ull, 2ull, 3ull, 7ull, 64ull, 997ull, 20011ull } )
+		assert( Same( engine.search_block( lo, lo+len ), BruteForce( lo, lo+len ) ) );
+	// Every edge offset across one jump table period.
+	const unsigned long long base = 5000000000ull;
+	for( unsigned long long off=0; off < std::min<unsigned long long>( 1ull << K, 300 ); ++off )
+	    assert( Same( engine.search_block( base+off, base+off+101 ), BruteForce( base+off, base+off+101 ) ) );
+    }
+}
+
+static void TestSearch()
+{
+    ThreadPool pool{4, SCHEDULING::WORK_STEALING};
+    pool.start();
+    for( unsigned int K : { 3, 10, 16 } ) {
+	const CollatzRangeEngine engine( K, size_t(1) << 18 );
+	for( unsigned long long first : { 1ull, 77031ull, 9999999989ull } )
+	    for( unsigned long long block : { 1ull, 1009ull, 65536ull } ) {
+		const unsigned long long last = first + 200000;
+		unsigned long long expect = first;
+		CollatzRecord best{ first, 0 };
+		const CollatzRecord r = engine.search( pool, first, last, block,
+		    [&]( unsigned long long lo, unsigned long long hi, const CollatzRecord& m ) {
+			assert( lo == expect && hi > lo && hi <= last && hi-lo <= block );
+			expect = hi;
+			if( hi-lo <= 1009 ) assert( Same( m, BruteForce( lo, hi ) ) );
+			if( m.count ) best = collatz_better( best, m );
+		    } );
+		assert( expect == last && Same( r, best ) && Same( r, BruteForce( first, last ) ) );
+	    }
+    }
+    // The default engine on the range of test_threadpool.
+    const CollatzRecord r = CollatzRangeEngine().search( pool, 1, 1000001 );
+    assert( r.NUM == 837799 && r.count == 525 );
+}
+
+int main()
+{
+    TestWide();
+    TestCount();
+    TestSearchBlock();
+    TestSearch();
+    std::cout << "Collatz tests passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,166 @@
+// test_philox.cpp
+// Unit test for the Philox4x32-10 generator and the MCI / BatchMCI / MultiMCI
+// sample streams.
+// Known answers are those published with Random123; an integral split into
+// ranges of samples must count exactly the hits of the serial loop, and
+// different streams of one seed must not repeat each other. Early stopping
+// must stop at the tolerance on exactly the first samples.
+// g++ -Wall -std=c++17 test_philox.cpp -o test_philox
+
+#include "monte_carlo_integration.h"
+#include <cassert>
+#include <iostream>
+#include <set>
+#include <cmath>
+
+using namespace MonteCarloIntegration;
+
+static void TestKnownAnswers()
+{
+    using C = Philox4x32::COUNTER;
+    assert( ( Philox4x32::generate( C{0,0,0,0}, {0,0} ) == C{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8} ) );
+    assert( ( Philox4x32::generate( C{~0u,~0u,~0u,~0u}, {~0u,~0u} ) == C{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd} ) );
+    assert( ( Philox4x32::generate( C{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0} )
+	      == C{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1} ) );
+}
+
+static void TestStreams()
+{
+    const PhiloxStream s0( 42, 0 ), s1( 42, 1 );
+    std::set<double> seen;
+    for( uint64_t i=0; i < 10000; ++i ) {
+	auto a = s0.uniform_pair( i ), b = s1.uniform_pair( i );
+	assert( a.first >= 0 && a.first < 1 && a.second >= 0 && a.second < 1 );
+	seen.insert( a.first ); seen.insert( a.second ); seen.insert( b.first ); seen.insert( b.second );
+    }
+    assert( seen.size() == 40000 );
+    double u0[100], u1[100];
+    s1.fill_pairs( 500, 100, u0, u1 );
+    for( int j=0; j < 100; ++j ) assert( s1.uniform_pair( 500+j ) == std::make_pair( u0[j], u1[j] ) );
+}
+
+static void TestSplitHits()
+{
+    auto f = []( double x ) { return 1 + x*x; };
+    const UNIVARIATE_FUNCTION F{f};
+    const int N = 100000;
+    MCI m( 0.0, 2.0, N, F, 7, 3 );
+    const uint64_t serial = m.Hits( 0, N );
+    uint64_t split = 0;
+    for( uint64_t lo=0; lo < N; lo += 777 ) split += m.Hits( lo, std::min<uint64_t>( N, lo+777 ) );
+    assert( split == serial );
+    assert( MCI( 0.0, 2.0, N, F, 7, 3 ).Integral() == m.Integral() );
+    const double exact = 2 + 8.0/3;
+    assert( std::abs( m.Integral()-exact ) < 0.05 );
+
+    // Batched kernel, scalar and block integrands: the same samples and hits.
+    BatchMCI scalar( 0.0, 2.0, N, f, 7, 3 );
+    auto block = [&f]( const double* x, double* y, size_t n ) { for( size_t j=0; j < n; ++j ) y[j] = f( x[j] ); };
+    BatchMCI blocked( 0.0, 2.0, N, block, 7, 3 );
+    assert( scalar.Hits( 0, N ) == serial && blocked.Hits( 0, N ) == serial );
+    assert( scalar.Hits( 100, 1000 ) == m.Hits( 100, 1000 ) );
+}
+
+// A polynomial gets the same samples, and hits, alone in BatchMCI or in a
+// shared-sample MultiMCI group; the mean value estimate is close to exact.
+static void TestSharedSamples()
+{
+    std::vector< Polynomial<double> > group( 3, Polynomial<double>(10) );
+    for( size_t k=0; k < group.size(); ++k ) group[k].RandomCoefficients( 100+k );
+    const int N = 50000;
+    MultiMCI multi( 1.15, 2.23, N, group, 11, 5 );
+    const std::vector<uint64_t> hits = multi.Hits( 0, N );
+    const std::vector<double> mean = multi.Integrals( ESTIMATOR::MEAN_VALUE );
+    for( size_t k=0; k < group.size(); ++k ) {
+	const Polynomial<double>& p = group[k];
+	BatchMCI single( 1.15, 2.23, N, [&p]( double x ) { return p( x ); }, 11, 5 );
+	assert( single.Hits( 0, N ) == hits[k] );
+	MultiMCI alone( 1.15, 2.23, N, { p }, 11, 5 );
+	assert( alone.Hits( 0, N )[0] == hits[k] );
+	const double exact = p.Integral( 1.15, 2.23 );
+	assert( std::abs( mean[k]-exact ) < 0.02*exact );
+    }
+}
+
+// Early stopping: the running variance matches a two pass one, a stopped
+// estimate is the hit or miss estimate over the samples it used, and a
+// looser tolerance stops sooner.
+static void TestTolerance()
+{
+    RunningStats all, merged, part;
+    std::vector<double> xs;
+    for( int i=0; i < 1000; ++i ) xs.push_back( 1e9 + ( i % 7 ) + 0.25*( i % 3 ) );
+    double mean = 0, m2 = 0;
+    for( double x : xs ) mean += x/xs.size();
+    for( double x : xs ) m2 += ( x-mean )*( x-mean );
+    for( size_t i=0; i < xs.size(); ++i ) {
+	all.add( xs[i] );
+	part.add( xs[i] );
+	if( i % 100 == 99 ) { merged.merge( part.n, part.mean, part.m2 ); part = RunningStats{}; }
+    }
+    assert( all.n == 1000 && merged.n == 1000 );
+    assert( std::abs( all.variance()-m2/999 ) < 1e-9*m2/999 && std::abs( merged.variance()-m2/999 ) < 1e-9*m2/999 );
+
+    auto f = []( double x ) { return 1 + x*x; };
+    const int N = 4000000;
+    BatchMCI m( 0.0, 2.0, N, f, 7, 3 );
+    const double exact = 2 + 8.0/3;
+    Tolerance loose, tight;
+    loose.relative = 1e-2;
+    tight.relative = 2e-3;
+    const MCIResult a = m.Integral( loose ), b = m.Integral( tight );
+    assert( a.converged && b.converged && a.samples < b.samples && b.samples < uint64_t(N) );
+    assert( a.samples % loose.block == 0 );
+    const double first = BatchMCI( 0.0, 2.0, a.samples, f, 7, 3 ).Integral();
+    assert( std::abs( a.estimate-first ) < 1e-12*first );
+    assert( 1.96*a.std_error <= 1e-2*a.estimate && std::abs( a.estimate-exact ) < 3*a.std_error );
+    assert( std::abs( b.estimate-exact ) < 3*b.std_error );
+    Tolerance never;
+    never.relative = 1e-6;
+    const MCIResult c = MCI( 0.0, 2.0, 100000, UNIVARIATE_FUNCTION{f}, 7, 3 ).Integral( never );
+    assert( !c.converged && c.samples == 100000 );
+}
+
+// Non-monotonic integrand with a negative part: the hit or miss box must
+// cover the interior maximum and the minimum; sample-mean and control
+// variate estimates must agree with much smaller errors.
+static void TestEstimators()
+{
+    auto f = []( double x ) { return std::sin( x ) + 0.1*x; };
+    const double A = 0.0, B = 3*M_PI/2;
+    const double exact = 1.0 + 0.05*B*B;
+    const int N = 200000;
+    BatchMCI m( A, B, N, f, 13, 1 );
+    const MCIResult hm = m.Integral( ESTIMATOR::HIT_OR_MISS );
+    const MCIResult mv = m.Integral( ESTIMATOR::MEAN_VALUE );
+    const MCIResult cv = m.Integral( ESTIMATOR::CONTROL_VARIATE );
+    std::cout << "hit or miss " << hm.estimate << " +- " << hm.std_error << "  mean " << mv.estimate << " +- " << mv.std_error
+	      << "  control variate " << cv.estimate << " +- " << cv.std_error << "  exact " << exact << std::endl;
+    for( const MCIResult& r : { hm, mv, cv } ) {
+	assert( r.samples == uint64_t(N) );
+	assert( std::abs( r.estimate-exact ) < 4*r.std_error );
+    }
+    assert( mv.std_error < hm.std_error && 5*cv.std_error < mv.std_error );
+    const UNIVARIATE_FUNCTION F{f};
+    const MCI scalar( A, B, N, F, 13, 1 );
+    assert( scalar.Integral() == m.Integral() );
+    assert( std::abs( scalar.Integral( ESTIMATOR::CONTROL_VARIATE ).estimate-cv.estimate ) < 1e-12 );
+
+    // A cubic is fitted exactly.
+    const Polynomial<double> cubic{ 1.0, -2.0, 0.5, 3.0 };
+    const Polynomial<double> fit = FitControlVariate( [&cubic]( const double* x, double* y, size_t n ) { cubic.evaluate( x, y, n ); },
+						      1.15, 2.23, 3 );
+    for( size_t i=0; i < 4; ++i ) assert( std::abs( fit.coefficient( i )-cubic.coefficient( i ) ) < 1e-9 );
+}
+
+int main()
+{
+    TestKnownAnswers();
+    TestStreams();
+    TestSplitHits();
+    TestSharedSamples();
+    TestTolerance();
+    TestEstimators();
+    std::cout << "test_philox passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,250 @@
+// test_polynomial.cpp
+// Unit test for Polynomial<T> and the fixed size Polynomial<T,N>.
+// The fixed size evaluators must be usable in constant expressions and
+// agree with the run time polynomial; its evaluators must outlive it and
+// plug into BatchMCI as concrete callables. The bulk SIMD evaluators must
+// match Horner to rounding on every kernel the CPU supports, including
+// tails shorter than a vector and polynomials past the Estrin limit.
+// Products on every path (Karatsuba, FFT, NTT, modular) must match the
+// schoolbook product; a = q b + r and a(b(x)) are checked directly.
+// g++ -Wall -std=c++17 test_polynomial.cpp -o test_polynomial
+// g++ -Wall -std=c++20 test_polynomial.cpp -o test_polynomial  (span overloads)
+
+#include "polynomial.h"
+#include "polynomial_arithmetic.h"
+#include "monte_carlo_integration.h"
+#include <cassert>
+#include <iostream>
+#include <cmath>
+
+using namespace MonteCarloIntegration;
+
+// 1 - 2x + 0.5x^2 + 3x^3
+constexpr Polynomial<double,4> CUBIC{ 1.0, -2.0, 0.5, 3.0 };
+static_assert( CUBIC( 2.0 ) == 1 - 4 + 2 + 24, "constexpr Horner" );
+static_assert( CUBIC.estrin()( 2.0 ) == 1 - 4 + 2 + 24, "constexpr Estrin" );
+static_assert( Polynomial<int,1>{ 7 }( 5 ) == 7, "constant polynomial" );
+static_assert( Polynomial<int,5>{ 1, 1, 1, 1, 1 }.estrin()( 2 ) == 31, "odd size Estrin" );
+static_assert( Polynomial<double,2>{ 0.0, 2.0 }.Integral( 0.0, 3.0 ) == 9.0, "constexpr Integral" );
+
+static void TestFixedAgainstDynamic()
+{
+    Polynomial<double> dynamic( 10 );
+    dynamic.RandomCoefficients( 42 );
+    Polynomial<double,10> fixed;
+    fixed.RandomCoefficients( 42 );
+    for( size_t i=0; i < 10; ++i ) assert( fixed.coefficient( i ) == dynamic.coefficient( i ) );
+    const auto horner = fixed.horner();
+    const auto estrin = fixed.estrin();
+    double x[100], y[100];
+    for( int j=0; j < 100; ++j ) x[j] = -2 + 0.04*j;
+    estrin( x, y, 100 );
+    for( int j=0; j < 100; ++j ) {
+	assert( horner( x[j] ) == dynamic( x[j] ) );
+	assert( std::abs( y[j]-dynamic( x[j] ) ) < 1e-12*( 1+std::abs( dynamic( x[j] ) ) ) );
+    }
+    assert( std::abs( fixed.Integral( 1.15, 2.23 )-dynamic.Integral( 1.15, 2.23 ) ) < 1e-12 );
+}
+
+static void TestEvaluatorLifetime()
+{
+    // getHorner() copies the coefficients; the evaluator outlives the polynomial.
+    std::function<double(double)> f;
+    HornerEvaluator<double,3> g{};
+    {
+	const Polynomial<double> p{ 1.0, 2.0, 3.0 };
+	f = p.getHorner();
+	g = Polynomial<double,3>( p ).horner();
+    }
+    assert( f( 2.0 ) == 17.0 && g( 2.0 ) == 17.0 );
+}
+
+static void TestBatchMCI()
+{
+    Polynomial<double,10> fixed;
+    fixed.RandomCoefficients( 7 );
+    const Polynomial<double> dynamic = [&]() { Polynomial<double> p( 10 ); p.RandomCoefficients( 7 ); return p; }();
+    const int N = 100000;
+    BatchMCI a( 1.15, 2.23, N, fixed.horner(), 3, 1 );
+    BatchMCI b( 1.15, 2.23, N, [&dynamic]( const double* x, double* y, size_t n ) { dynamic.evaluate( x, y, n ); }, 3, 1 );
+    assert( a.Hits( 0, N ) == b.Hits( 0, N ) );
+    // MCI keeps its own copy of a temporary integrand.
+    MCI c( 1.15, 2.23, N, fixed.horner(), 3, 1 );
+    assert( c.Hits( 0, N ) == b.Hits( 0, N ) );
+}
+
+static void TestBulk()
+{
+    using namespace POLYNOMIAL_SIMD;
+    std::vector<double> x( 1003 );
+    for( size_t j=0; j < x.size(); ++j ) x[j] = -1.5 + 3.0*j/x.size();
+    for( size_t K : { 1, 2, 3, 8, 11, 33, 64, 65, 100 } ) {
+	Polynomial<double> p( K );
+	p.RandomCoefficients( K );
+	std::vector<double> ref( x.size() ), y( x.size() );
+	p.evaluate( x.data(), ref.data(), x.size() );
+	// Horner and Estrin both err by O( K eps sum_i |c_i| |x_j|^i ) at x_j.
+	std::vector<double> tol( x.size() );
+	for( size_t j=0; j < x.size(); ++j ) {
+	    double bound = 0;
+	    for( size_t i=K; i-- > 0; ) bound = std::fabs( p.coefficient( i ) ) + bound*std::fabs( x[j] );
+	    tol[j] = K*1e-15*bound;
+	}
+	for( ISA isa : { ISA::SCALAR, ISA::AVX2, ISA::AVX512 } ) {
+	    if( !supported( isa ) ) continue;
+	    for( size_t n : { size_t(0), size_t(1), size_t(7), x.size() } ) {
+		std::fill( y.begin(), y.end(), -1.0 );
+		POLYNOMIAL_SIMD::evaluate( &p.coefficient( 0 ), K, x.data(), y.data(), n, isa );
+		for( size_t j=0; j < n; ++j ) assert( std::fabs( y[j]-ref[j] ) <= tol[j] );
+		for( size_t j=n; j < x.size(); ++j ) assert( y[j] == -1.0 );
+	    }
+	}
+    }
+    // Several polynomials at once, row k is P[k].
+    std::vector< Polynomial<double> > P;
+    for( size_t k=0; k < 5; ++k ) {
+	P.emplace_back( 3+2*k );
+	P.back().RandomCoefficients( 100+k );
+    }
+    std::vector<double> all( P.size()*x.size() ), one( x.size() );
+    Polynomial<double>::evaluate_bulk( P, x.data(), all.data(), x.size() );
+    for( size_t k=0; k < P.size(); ++k ) {
+	P[k].evaluate_bulk( x.data(), one.data(), x.size() );
+	for( size_t j=0; j < x.size(); ++j ) assert( all[k*x.size()+j] == one[j] );
+    }
+#ifdef __cpp_lib_span
+    std::vector<double> out( x.size() );
+    P[0].evaluate( std::span<const double>( x ), std::span<double>( out ) );
+    P[0].evaluate_bulk( x.data(), one.data(), x.size() );
+    assert( out == one );
+    Polynomial<double>::evaluate( P, std::span<const double>( x ), std::span<double>( all ) );
+    assert( all[4*x.size()+7] == [&]{ P[4].evaluate_bulk( x.data(), one.data(), x.size() ); return one[7]; }() );
+#endif
+    std::cout << "bulk evaluation: " << name( best() ) << std::endl;
+}
+
+template <typename T>
+static std::vector<T> Schoolbook( const std::vector<T>& a, const std::vector<T>& b )
+{
+    std::vector<T> c( a.size()+b.size()-1, T(0) );
+    for( size_t i=0; i < a.size(); ++i )
+	for( size_t j=0; j < b.size(); ++j ) c[i+j] += a[i]*b[j];
+    return c;
+}
+
+static Polynomial<double> Random( size_t n, uint64_t seed )
+{
+    Polynomial<double> p( n );
+    p.RandomCoefficients( seed );
+    return p;
+}
+
+static Polynomial<int64_t> RandomInteger( size_t n, uint64_t seed, int64_t range )
+{
+    std::mt19937_64 gen( seed );
+    std::uniform_int_distribution<int64_t> d( -range, range );
+    std::vector<int64_t> c( n );
+    for( auto& v : c ) v = d( gen );
+    return Polynomial<int64_t>( c );
+}
+
+static void TestArithmetic()
+{
+    for( size_t n : { 1, 5, 31, 32, 77, 130, 700 } )
+	for( size_t m : { 1, 40, 129, 300, 1000 } ) {
+	    const Polynomial<double> a = Random( n, n ), b = Random( m, m+1 );
+	    const std::vector<double> ref = Schoolbook( a.coefficients(), b.coefficients() );
+	    const Polynomial<double> c = a*b;
+	    assert( c.size() == ref.size() );
+	    for( size_t i=0; i < ref.size(); ++i ) assert( std::fabs( c.coefficient( i )-ref[i] ) < 1e-12*std::min( n, m ) );
+	    // The transforms only pay off past thousands of coefficients, so
+	    // the kernels are also run directly.
+	    std::vector<double> f( ref.size(), 0.0 );
+	    POLYNOMIAL_ARITHMETIC::fft_multiply( a.coefficients().data(), n, b.coefficients().data(), m, f.data() );
+	    for( size_t i=0; i < ref.size(); ++i ) assert( std::fabs( f[i]-ref[i] ) < 1e-12*std::min( n, m ) );
+	    const Polynomial<int64_t> x = RandomInteger( n, n, 1 << 20 ), y = RandomInteger( m, m, 1 << 20 );
+	    const std::vector<int64_t> exact = Schoolbook( x.coefficients(), y.coefficients() );
+	    assert( ( x*y ).coefficients() == exact );
+	    std::vector<int64_t> t( exact.size(), 0 );
+	    POLYNOMIAL_ARITHMETIC::ntt_multiply( x.coefficients(), y.coefficients(), t.data() );
+	    assert( t == exact );
+	    // Modular: coefficients in [0, mod) against the reduced schoolbook product.
+	    const uint32_t mod = 4294967291u;
+	    Polynomial<int64_t> u( n ), v( m );
+	    for( size_t i=0; i < n; ++i ) u.coefficient( i ) = ( x.coefficient( i )*2654435761 % mod + mod ) % mod;
+	    for( size_t i=0; i < m; ++i ) v.coefficient( i ) = ( y.coefficient( i )*40503 % mod + mod ) % mod;
+	    std::vector<int64_t> w( n+m-1, 0 );
+	    for( size_t i=0; i < n; ++i )
+		for( size_t j=0; j < m; ++j )
+		    w[i+j] = static_cast<int64_t>( ( uint64_t( w[i+j] ) + uint64_t( u.coefficient( i ) )*uint64_t( v.coefficient( j ) ) % mod ) % mod );
+	    assert( multiply_mod( u, v, mod ).coefficients() == w );
+	}
+    for( size_t n : { 3, 40, 200 } ) {
+	const Polynomial<double> a = Random( n, 3 );
+	const Polynomial<double> s = square( a ), p = a*a;
+	for( size_t i=0; i < s.size(); ++i ) assert( std::fabs( s.coefficient( i )-p.coefficient( i ) ) < 1e-12*n );
+    }
+    // a = q b + r, deg r < deg b. Random divisors give huge quotients, so
+    // the error is against the size of q b.
+    for( size_t n : { 1, 10, 300, 700 } )
+	for( size_t m : { 1, 3, 150, 400 } ) {
+	    const Polynomial<double> a = Random( n, 2*n ), b = Random( m, 3*m );
+	    const auto qr = divide( a, b );
+	    assert( qr.second.size() == std::max<size_t>( 1, m-1 ) );
+	    const Polynomial<double> back = qr.first*b + qr.second;
+	    double scale = 1;
+	    for( size_t i=0; i < qr.first.size(); ++i ) scale = std::max( scale, m*std::fabs( qr.first.coefficient( i ) ) );
+	    assert( back.size() >= n );
+	    for( size_t i=0; i < back.size(); ++i )
+		assert( std::fabs( back.coefficient( i ) - ( i < n ? a.coefficient( i ) : 0.0 ) ) < 1e-13*scale );
+	    // Exact types, by long division and by Newton: a monic divisor
+	    // over the integers modulo 2^64.
+	    std::vector<uint64_t> x( n ), y( m );
+	    for( size_t i=0; i < n; ++i ) x[i] = RandomInteger( 1, n+i, 1 << 30 ).coefficient( 0 );
+	    for( size_t i=0; i < m; ++i ) y[i] = RandomInteger( 1, 7*m+i, 1 << 30 ).coefficient( 0 );
+	    y[m-1] = 1;
+	    const Polynomial<uint64_t> X( x ), Y( y );
+	    const auto xy = divide( X, Y );
+	    std::vector<uint64_t> z = ( xy.first*Y + xy.second ).coefficients();
+	    x.resize( z.size(), 0 );
+	    assert( z == x );
+	}
+    {
+	// Past NEWTON_THRESHOLD: Newton division.
+	const size_t n = 20000, m = 9000;
+	std::vector<uint64_t> x( n ), y( m );
+	for( size_t i=0; i < n; ++i ) x[i] = i*i;
+	for( size_t i=0; i < m; ++i ) y[i] = 3*i+1;
+	y[m-1] = 1;
+	const Polynomial<uint64_t> X( x ), Y( y );
+	const auto xy = divide( X, Y );
+	std::vector<uint64_t> z = ( xy.first*Y + xy.second ).coefficients();
+	x.resize( z.size(), 0 );
+	assert( z == x );
+    }
+    assert( ( Polynomial<int>{ -1, 0, 1 } / Polynomial<int>{ 1, 1 } ).coefficients() == std::vector<int>( { -1, 1 } ) );
+    assert( ( Polynomial<int>{ -1, 0, 1 } % Polynomial<int>{ 1, 1 } ).coefficients() == std::vector<int>{ 0 } );
+    assert( ( Polynomial<int>{ -1, 0, 1 } / Polynomial<int>{ 1, -1 } ).coefficients() == std::vector<int>( { -1, -1 } ) );
+    // a(b(x)) at a few points; a of 100 coefficients so compose splits and squares.
+    const Polynomial<double> a = Random( 100, 5 ), b{ 0.25, -0.5, 0.125 };
+    const Polynomial<double> ab = compose( a, b );
+    assert( ab.size() == 99*2+1 );
+    for( double t : { -1.0, 0.0, 0.3, 1.0 } ) assert( std::fabs( ab( t )-a( b( t ) ) ) < 1e-12*std::fabs( a( b( t ) ) ) );
+    assert( ( compose( Polynomial<int>{ 1, 2, 3 }, Polynomial<int>{ 0, 1, 1 } ) ).coefficients()
+	    == std::vector<int>( { 1, 2, 5, 6, 3 } ) );
+    assert( derivative( Polynomial<int>{ 5, 3, 0, 4 } ).coefficients() == std::vector<int>( { 3, 0, 12 } ) );
+    assert( derivative( Polynomial<int>{ 5 } ).coefficients() == std::vector<int>{ 0 } );
+    assert( ( -Polynomial<int>{ 1, 2 } + Polynomial<int>{ 1 } - Polynomial<int>{ 0, 0, 3 } ).coefficients()
+	    == std::vector<int>( { 0, -2, -3 } ) );
+}
+
+int main()
+{
+    TestFixedAgainstDynamic();
+    TestEvaluatorLifetime();
+    TestBatchMCI();
+    TestBulk();
+    TestArithmetic();
+    std::cout << "Polynomial tests passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,130 @@
+// test_quadrature.cpp
+// Unit test for the adaptive quadrature (Gauss-Kronrod, tanh-sinh).
+// The rule tables must integrate polynomials to their degree; the degree 9
+// polynomials of TestMonteCarlo must come out to rounding from one
+// interval; a narrow peak must converge with an honest error estimate and
+// the same result on one thread or four; tanh-sinh must handle endpoint
+// singularities in far fewer evaluations than bisection.
+// g++ -O2 -Wall -std=c++17 -pthread test_quadrature.cpp -o test_quadrature
+
+#include "quadrature.h"
+#include "polynomial.h"
+#include "checkpoint.h"
+#include <cassert>
+#include <iostream>
+#include <cmath>
+
+using namespace Quadrature;
+using namespace THREAD_POOL;
+
+template <size_t NK, size_t NG>
+constexpr double KronrodWeightSum( const KronrodRule<NK,NG>& rule ) {
+    double s = rule.wk[NK-1];
+    for( size_t j=0; j+1 < NK; ++j ) s += 2*rule.wk[j];
+    return s;
+}
+// std::fabs is not constexpr before C++23.
+constexpr double Abs( double x ) { return x < 0 ? -x : x; }
+static_assert( Abs( KronrodWeightSum( GK15 )-2 ) < 1e-15 && Abs( KronrodWeightSum( GK21 )-2 ) < 1e-15,
+	       "Kronrod weights integrate 1 over [-1,1]" );
+static_assert( GK15.evaluations() == 15 && GK21.evaluations() == 21, "rule sizes" );
+
+// x^k on [-1,1] for the degrees each rule is exact to (Kronrod 3n+1).
+template <size_t NK, size_t NG>
+static void TestRule( const KronrodRule<NK,NG>& rule, int degree )
+{
+    for( int k=0; k <= degree; ++k ) {
+	const Interval i = kronrod( [k]( double x ) { return std::pow( x, k ); }, -1.0, 1.0, rule );
+	const double exact = ( k & 1 ) ? 0.0 : 2.0/( k+1 );
+	assert( std::fabs( i.value-exact ) < 1e-15 );
+    }
+}
+
+static void TestPolynomials()
+{
+    // The integrals of the driver: one interval, 21 evaluations, rounding error.
+    const double A = 1.15, B = 2.23;
+    for( uint64_t i=0; i < 100; ++i ) {
+	Polynomial<double> px( 10 );
+	px.RandomCoefficients( CHECKPOINT::item_seed( 1, 2*i ) );
+	const UNIVARIATE_FUNCTION f = px.getHorner();
+	const QuadratureResult r = gauss_kronrod( f, A, B );
+	const double exact = px.Integral( A, B );
+	assert( r.converged && r.intervals == 1 && r.evaluations == 21 );
+	assert( std::fabs( r.estimate-exact ) < 1e-14*exact );
+	assert( std::fabs( r.estimate-exact ) <= r.error );
+    }
+}
+
+static void TestPeak()
+{
+    // 1/( e^2 + (x-0.3)^2 ) on [0,1].
+    const double e = 1e-3;
+    auto f = [e]( double x ) { return 1/( e*e + ( x-0.3 )*( x-0.3 ) ); };
+    const double exact = ( std::atan( 0.7/e ) + std::atan( 0.3/e ) )/e;
+    for( RULE rule : { RULE::GK15, RULE::GK21 } ) {
+	const QuadratureResult r = gauss_kronrod( f, 0.0, 1.0, Tolerance(), rule );
+	std::cout << "peak GK" << ( rule == RULE::GK15 ? 15 : 21 ) << " " << r.estimate-exact << " +- " << r.error
+		  << " evaluations " << r.evaluations << " intervals " << r.intervals << std::endl;
+	assert( r.converged && r.error <= 1e-12*exact );
+	assert( std::fabs( r.estimate-exact ) <= r.error );
+    }
+    // Parallel rounds: same result on any number of threads.
+    ThreadPool one{1, SCHEDULING::GLOBAL_QUEUE}, four{4, SCHEDULING::WORK_STEALING};
+    one.start();
+    four.start();
+    assert( one.size() == 1 && four.size() == 4 );
+    const QuadratureResult a = gauss_kronrod( one, f, 0.0, 1.0 ), b = gauss_kronrod( four, f, 0.0, 1.0 );
+    assert( a.converged && a.estimate == b.estimate && a.error == b.error && a.evaluations == b.evaluations );
+    assert( std::fabs( a.estimate-exact ) <= a.error );
+    // Out of intervals: an estimate, but not converged.
+    Tolerance tight;
+    tight.max_intervals = 4;
+    const QuadratureResult c = gauss_kronrod( f, 0.0, 1.0, tight );
+    assert( !c.converged && c.intervals == 4 );
+}
+
+static void TestSingular()
+{
+    auto inv_sqrt = []( double x ) { assert( x > 0 && x < 1 ); return 1/std::sqrt( x ); };
+    auto log_x = []( double x ) { assert( x > 0 && x < 1 ); return std::log( x ); };
+    const QuadratureResult s = tanh_sinh( inv_sqrt, 0.0, 1.0 ), l = tanh_sinh( log_x, 0.0, 1.0 );
+    std::cout << "tanh-sinh 1/sqrt(x) " << s.estimate-2 << " evaluations " << s.evaluations
+	      << ", log(x) " << l.estimate+1 << " evaluations " << l.evaluations << std::endl;
+    assert( s.converged && std::fabs( s.estimate-2 ) < 1e-12 );
+    assert( l.converged && std::fabs( l.estimate+1 ) < 1e-12 );
+    // Smooth integrands converge as well, and on a general interval.
+    const QuadratureResult c = tanh_sinh( []( double x ) { return std::cos( x ); }, -1.0, 2.0 );
+    assert( c.converged && std::fabs( c.estimate-( std::sin( 2.0 )+std::sin( 1.0 ) ) ) < 1e-13 );
+    // Reversed bounds negate the integral, as for gauss_kronrod.
+    auto square = []( double x ) { return x*x; };
+    const QuadratureResult rs = tanh_sinh( square, 2.0, 0.0 ), rg = gauss_kronrod( square, 2.0, 0.0 );
+    assert( rs.converged && std::fabs( rs.estimate+8.0/3 ) < 1e-13 );
+    assert( rg.converged && std::fabs( rg.estimate+8.0/3 ) < 1e-13 );
+    const QuadratureResult rl = tanh_sinh( log_x, 1.0, 0.0 );
+    assert( rl.converged && std::fabs( rl.estimate-1 ) < 1e-12 && rl.evaluations == l.evaluations );
+    // Gauss-Kronrod has to bisect towards the singularity.
+    const QuadratureResult g = gauss_kronrod( inv_sqrt, 0.0, 1.0 );
+    std::cout << "GK21 1/sqrt(x) " << g.estimate-2 << " evaluations " << g.evaluations << std::endl;
+    assert( std::fabs( g.estimate-2 ) < 1e-10 && s.evaluations*5 < g.evaluations );
+    // Singular at B: bisection puts a Kronrod node onto 1.0, where f is
+    // inf. That must end the run unconverged, not converge to inf.
+    auto inv_sqrt_b = []( double x ) { return 1/std::sqrt( 1-x ); };
+    const QuadratureResult gb = gauss_kronrod( inv_sqrt_b, 0.0, 1.0 );
+    std::cout << "GK21 1/sqrt(1-x) " << gb.estimate << " +- " << gb.error << " intervals " << gb.intervals << std::endl;
+    assert( !gb.converged && !std::isfinite( gb.estimate ) );
+    ThreadPool pool{2, SCHEDULING::WORK_STEALING};
+    pool.start();
+    assert( !gauss_kronrod( pool, inv_sqrt_b, 0.0, 1.0 ).converged );
+}
+
+int main()
+{
+    TestRule( GK15, 22 );
+    TestRule( GK21, 31 );
+    TestPolynomials();
+    TestPeak();
+    TestSingular();
+    std::cout << "Quadrature tests passed." << std::endl;
+    return 0;
+}
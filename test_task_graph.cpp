@@ -0,0 +1,60 @@
+// test_task_graph.cpp
+// Unit test for THREAD_POOL::TaskGraph.
+// A diamond (parse -> {classify, measure} -> output) plus a long chain is built
+// once and run repeatedly on both scheduling modes; every node must see all of
+// its predecessors finished. A throwing node must surface from run() and skip
+// its successors only.
+// g++ -Wall -std=c++17 test_task_graph.cpp -o test_task_graph -pthread
+
+#include "task_graph.h"
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+using namespace THREAD_POOL;
+
+static void TestDiamondAndChain( SCHEDULING MODE )
+{
+    ThreadPool pool{4, MODE};
+    pool.start();
+    std::atomic<int> parsed{0}, classified{0}, measured{0}, written{0};
+    TaskGraph graph;
+    auto parse    = graph.add( [&]() { parsed++; } );
+    auto classify = graph.add( [&]() { assert( parsed == classified+1 ); classified++; }, { parse } );
+    auto measure  = graph.add( [&]() { assert( parsed == measured+1 ); measured++; }, { parse } );
+    graph.add( [&]() { assert( classified == written+1 && measured == written+1 ); written++; }, { classify, measure } );
+
+    // 1000 node chain: each stage checks its predecessor ran in this round.
+    std::vector<int> stage(1000, 0);
+    TaskGraph::NODE previous = graph.add( [&]() { stage[0]++; } );
+    for( size_t i=1; i < stage.size(); ++i ) {
+        previous = graph.add( [&stage,i]() { assert( stage[i-1] == stage[i]+1 ); stage[i]++; }, { previous } );
+    }
+
+    const int RUNS = 200;
+    for( int r=0; r < RUNS; ++r ) graph.run( pool );
+    assert( written == RUNS && stage.back() == RUNS );
+}
+
+static void TestFailure()
+{
+    ThreadPool pool{2, SCHEDULING::WORK_STEALING};
+    pool.start();
+    int before = 0, after = 0, independent = 0;
+    TaskGraph graph;
+    auto a = graph.add( [&]() { before++; } );
+    auto b = graph.add( []() { throw std::runtime_error( "stage failed" ); }, { a } );
+    graph.add( [&]() { after++; }, { b } );
+    graph.add( [&]() { independent++; } );
+    bool thrown = false;
+    try { graph.run( pool ); } catch( const std::runtime_error& ) { thrown = true; }
+    assert( thrown && before == 1 && after == 0 && independent == 1 );
+}
+
+int main() {
+    TestDiamondAndChain( SCHEDULING::GLOBAL_QUEUE );
+    TestDiamondAndChain( SCHEDULING::WORK_STEALING );
+    TestFailure();
+    std::cout << "TaskGraph unit test passed." << std::endl;
+    return 0;
+}
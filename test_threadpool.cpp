@@ -6,86 +6,61 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "threadpool.h"
+#include "collatz.h"
 #include <iostream>
 #include <vector>
 #include <memory>
-#include <gmpxx.h>
+#include <string>
 
 using namespace THREAD_POOL;
 
-int collatz_count( int N ) {
-  mpz_class GN = N;
-  int ORIG_N = N;
-  int retval = 1;
-  while( GN != 1 ) {
-    if( GN < 0 ) std::cout << "ORIG N overflows: " << ORIG_N << "\t" << GN << std::endl;
-    assert( GN > 0 ); // must be overflowing
-    if( ( GN % 2 ) == 0 ) GN = GN /2;
-    else GN = 3*GN+1;
-    retval++;
-    if( GN == 0 ) { std::cout << ORIG_N << std::endl; break;}
-  }
-  return retval;
-}
-
-struct CollatzOperator
-{
-  unsigned int NUM;
-  unsigned int count;
-  explicit CollatzOperator(unsigned int i=1): NUM{i}, count{0} {}
-  void operator()() { count = collatz_count( NUM ); }
-  std::function<void()> getLambda() { return [this]()->void { this->operator()(); }; }
-  //~CollatzOperator() { std::cout << __FUNCTION__ << std::endl; }
-};
-
 
-static void TestThreadPool(unsigned int N, unsigned int M)
+static void TestThreadPool(unsigned int N, unsigned int M, SCHEDULING MODE)
 {
   const unsigned int NUM_THREADS = std::thread::hardware_concurrency();
   std::cout << "System supports " << NUM_THREADS << " threads.\n";
   unsigned int ACTUAL_THREAD_COUNT = std::min( N, NUM_THREADS );
-  ThreadPool mypool{ACTUAL_THREAD_COUNT};
-  std::vector< std::thread > my_threads;
-  for( unsigned int i=0; i < ACTUAL_THREAD_COUNT; ++i ) {
-    my_threads.push_back( std::thread( &ThreadPool::run, &mypool ) );
-  }
-  std::vector< CollatzOperator > jobs(M);
-  for( unsigned int i=0; i < M; ++i ) {
-    jobs[i].NUM = i+1;
-    mypool.add( jobs[i].getLambda() );
-    // Bind is not preferable as then we have to use std::shared_ptr
-    //mypool.add( std::bind( &CollatzOperator::operator(), jobs[i] ) );
-  }
-  mypool.complete();
-  for( unsigned int i=0; i < ACTUAL_THREAD_COUNT; ++i ) {
-    my_threads[i].join();
-  }
-  std::pair<unsigned int, unsigned int> MAX_COLLATZ;
-  MAX_COLLATZ.first = jobs[0].NUM;
-  MAX_COLLATZ.second= jobs[0].count;
-  for( const auto& x : jobs ) {
-    if( ( x.NUM % 10000 ) == 0 ) std::cout << x.NUM << "\t" << x.count << "\n";
-    if( MAX_COLLATZ.second < x.count ) {
-      MAX_COLLATZ.first = x.NUM;
-      MAX_COLLATZ.second= x.count;
-    }
-  }
+  ThreadPool mypool{ACTUAL_THREAD_COUNT, MODE};
+  mypool.start();
+  // Results stream into a max-reduction; only every 10000th count is kept
+  // (as a future) for the progress listing.
+  using RESULT = std::pair<unsigned int, unsigned int>;
+  auto max_count = [](const RESULT& a, const RESULT& b) -> RESULT {
+    if( a.second != b.second ) return ( a.second > b.second ) ? a : b;
+    return ( a.first < b.first ) ? a : b;
+  };
+  Reduction<RESULT, decltype(max_count)> reduction{ mypool, RESULT{1,1}, max_count };
+  std::vector< std::pair<unsigned int, std::future<int>> > progress;
+  for( unsigned int NUM=10000; NUM <= M; NUM += 10000 )
+    progress.emplace_back( NUM, mypool.submit( collatz_count, NUM ) );
+  // Batches of BATCH_CHUNK: each deque lock taken once per batch, at most M wakeups.
+  reduction.submit_range( 1, size_t(M)+1, []( size_t NUM ) -> RESULT {
+      return RESULT{ static_cast<unsigned int>( NUM ), static_cast<unsigned int>( collatz_count( NUM ) ) };
+    } );
+  const RESULT MAX_COLLATZ = reduction.get();
+  for( auto& p : progress ) std::cout << p.first << "\t" << p.second.get() << "\n";
   std::cout << "MAX COLLATZ = " << MAX_COLLATZ.first << "\t" << MAX_COLLATZ.second << std::endl;
 }
 
 
 static void Usage( const char* progName )
 {
-  std::cout << progName << " N (threads) M (number-trials) " << std::endl;
+  std::cout << progName << " N (threads) M (number-trials) [global|steal]" << std::endl;
   exit(-1);
 }
 int main(int argc, char* argv[])
 {
   int N = 10, M=10000;
-  if( argc == 3 ) 
+  SCHEDULING MODE = SCHEDULING::GLOBAL_QUEUE;
+  if( argc == 3 || argc == 4 ) 
     N = atoi( argv[1] ), M = atoi( argv[2] );
   else
     Usage( argv[0] );
-  TestThreadPool(N,M);
+  if( argc == 4 ) {
+    std::string mode = argv[3];
+    if( mode == "steal" ) MODE = SCHEDULING::WORK_STEALING;
+    else if( mode != "global" ) Usage( argv[0] );
+  }
+  TestThreadPool(N,M,MODE);
   return (0);
 }
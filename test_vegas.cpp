@@ -0,0 +1,101 @@
+// test_vegas.cpp
+// Unit test for the VEGAS integrator.
+// Narrow peaks in 1-D and 4-D must come out within a few standard errors of
+// the exact value, with an error far below that of plain Monte Carlo at the
+// same number of evaluations; the result must not depend on the number of
+// threads.
+// g++ -O2 -Wall -std=c++17 -pthread test_vegas.cpp -o test_vegas
+
+#include "vegas.h"
+#include <cassert>
+#include <iostream>
+#include <cmath>
+
+using namespace MonteCarloIntegration;
+using namespace THREAD_POOL;
+
+// Normalized Gaussian of width a at 1/2 on each axis; integral over
+// [0,1]^D is erf( 1/(2a) )^D.
+template <unsigned int D>
+static double Peak( const double* x )
+{
+    constexpr double a = 0.05;
+    double r2 = 0;
+    for( unsigned int j=0; j < D; ++j ) r2 += ( x[j]-0.5 )*( x[j]-0.5 );
+    return std::exp( -r2/( a*a ) )/std::pow( a*std::sqrt( M_PI ), D );
+}
+
+// Plain MC standard error of Peak<D> with N uniform samples.
+template <unsigned int D>
+static double PlainError( uint64_t N )
+{
+    const PhiloxStream rng( 3, 0 );
+    double sum = 0, sum2 = 0;
+    double x[D];
+    for( uint64_t i=0; i < N; ++i ) {
+	for( unsigned int j=0; j < D; j += 2 ) {
+	    const auto u = rng.uniform_pair( i*D + j );
+	    x[j] = u.first;
+	    if( j+1 < D ) x[j+1] = u.second;
+	}
+	const double f = Peak<D>( x );
+	sum += f;
+	sum2 += f*f;
+    }
+    const double mean = sum/N;
+    return std::sqrt( ( sum2/N - mean*mean )/N );
+}
+
+static void TestPeak1D( ThreadPool& pool )
+{
+    Vegas v( 0.0, 1.0 );
+    v.adapt( pool, []( double x ) { return Peak<1>( &x ); }, 2000, 5 );
+    const VegasResult r = v.integrate( pool, []( double x ) { return Peak<1>( &x ); }, 2000, 10 );
+    const double exact = std::erf( 10.0 );
+    std::cout << "1-D " << r.estimate << " +- " << r.std_error << " chi2/dof " << r.chi2_dof
+	      << " plain " << PlainError<1>( r.evaluations ) << std::endl;
+    assert( r.evaluations == 20000 );
+    assert( std::fabs( r.estimate-exact ) < 5*r.std_error );
+    assert( r.std_error*20 < PlainError<1>( r.evaluations ) );
+}
+
+static void TestPeak4D( ThreadPool& pool )
+{
+    const std::vector<double> lower( 4, 0.0 ), upper( 4, 1.0 );
+    Vegas v( lower, upper );
+    v.adapt( pool, Peak<4>, 20000, 10 );
+    const VegasResult r = v.integrate( pool, Peak<4>, 20000, 10 );
+    const double exact = std::pow( std::erf( 10.0 ), 4 );
+    std::cout << "4-D " << r.estimate << " +- " << r.std_error << " chi2/dof " << r.chi2_dof
+	      << " plain " << PlainError<4>( r.evaluations ) << std::endl;
+    assert( std::fabs( r.estimate-exact ) < 5*r.std_error );
+    assert( r.std_error*20 < PlainError<4>( r.evaluations ) );
+}
+
+static void TestThreads()
+{
+    // Same seed, one thread or four: the same numbers to the last bit.
+    const std::vector<double> lower( 3, -1.0 ), upper( 3, 2.0 );
+    auto f = []( const double* x ) { return std::exp( -x[0]*x[0] - 2*x[1]*x[1] - 3*x[2]*x[2] ); };
+    ThreadPool one{1, SCHEDULING::GLOBAL_QUEUE}, four{4, SCHEDULING::WORK_STEALING};
+    one.start();
+    four.start();
+    assert( one.size() == 1 && four.size() == 4 );
+    Vegas a( lower, upper, 40, 9 ), b( lower, upper, 40, 9 );
+    const VegasResult ra = a.integrate( one, f, 5000, 6 ), rb = b.integrate( four, f, 5000, 6 );
+    assert( ra.estimate == rb.estimate && ra.std_error == rb.std_error && ra.chi2_dof == rb.chi2_dof );
+    assert( ra.iterations == rb.iterations && ra.evaluations == rb.evaluations );
+    for( unsigned int j=0; j < 3; ++j )
+	for( unsigned int i=0; i <= 40; ++i ) assert( a.edge( j, i ) == b.edge( j, i ) );
+}
+
+int main()
+{
+    ThreadPool pool{4, SCHEDULING::WORK_STEALING};
+    pool.start();
+    TestPeak1D( pool );
+    TestPeak4D( pool );
+    TestThreads();
+    std::cout << "VEGAS tests passed." << std::endl;
+    return 0;
+}
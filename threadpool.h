@@ -3,43 +3,422 @@
 // Author : Sandeep Koranne (C) 2020. All rights reserved.
 // Purpose: Simple thread pool for futures
 //
+// submit() wraps any callable in a packaged_task and returns its future;
+// when_all()/reduce() drain a batch of futures and Reduction folds results
+// into per-worker partials as tasks finish, so callers need not keep one
+// result object alive per task.
+//
+// Queued work is held as Task: a move only callable with 48 bytes of inline
+// storage, kept in TaskRing buffers of preallocated slots. Enqueue/dequeue of
+// a small closure does not touch the heap once the ring has grown to the
+// working set; larger closures fall back to one allocation.
+//
+// Workers are either supplied by the caller (threads running run(), joined
+// by the caller after complete()) or owned by the pool: start()/resize()
+// spawn and retire them at runtime, the destructor drains and joins. Idle
+// workers spin for spin_limit() polls before parking on the condition
+// variable, and add() only notifies when somebody is parked.
+//
+// PLACEMENT pins slotted workers (cpu_topology.h): CORES gives each slot one
+// CPU, NUMA_NODES lets it float within one node. Slots are spread evenly over
+// the node-major CPU list, stealing tries same-node deques first, and
+// outside threads add to deques on the node they are running on. Threads
+// calling run() get their original affinity back when it returns.
+//
+// Every queue has one lane per PRIORITY; workers take HIGH work before
+// NORMAL before LOW, looking at other deques for a higher lane before their
+// own lower one. add_batch()/add_range() enqueue N tasks in chunks of
+// BATCH_CHUNK, taking each deque lock once per chunk and waking at most N
+// parked workers; the tasks are built a chunk at a time, so a range of
+// millions needs no task-count-sized vector beside the queues.
+//
+// Building with -DTHREAD_POOL_STATS turns on per worker counters and trace
+// logging (threadpool_stats.h): see stats(), tracing() and write_trace().
+//
+// Two scheduling modes are supported:
+// GLOBAL_QUEUE  : every worker waits on one mutex protected queue (original)
+// WORK_STEALING : each worker owns a deque, pushes/pops its own tasks at the
+//               : back (LIFO, cache warm) and steals from the front of the
+//               : other deques when it runs dry. Only the sleep/wakeup path
+//               : touches the pool wide mutex.
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <cassert>
 #include <functional>
 #include <atomic>
-#include <queue>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
 #include <future>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <optional>
+#include <exception>
+#include <new>
+#include <cstddef>
+#include <algorithm>
+#include "threadpool_stats.h"
+#include "cpu_topology.h"
 
 #pragma once
 
 namespace THREAD_POOL {
 
+  enum class SCHEDULING { GLOBAL_QUEUE, WORK_STEALING };
+  enum class PLACEMENT { NONE, CORES, NUMA_NODES };
+  enum class PRIORITY { HIGH, NORMAL, LOW };
+  constexpr unsigned int PRIORITY_LANES = 3;
+
+  inline void cpu_relax()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile( "yield" );
+#endif
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Move only void() callable with small object storage. sizeof(Task) is one
+  // cache line; closures that fit INLINE_SIZE and move without throwing are
+  // stored in place, others on the heap.
+  ////////////////////////////////////////////////////////////////////////////////
+  class Task {
+  public:
+    static constexpr size_t INLINE_SIZE = 48;
+    Task() = default;
+    template <typename F, typename = std::enable_if_t< !std::is_same< std::decay_t<F>, Task >::value >>
+    Task( F&& f ) { construct< std::decay_t<F> >( std::forward<F>( f ) ); }
+    Task( Task&& other ) noexcept { move_from( other ); }
+    Task& operator=( Task&& other ) noexcept {
+      if( this != &other ) { reset(); move_from( other ); }
+      return *this;
+    }
+    Task( const Task& ) = delete;
+    Task& operator=( const Task& ) = delete;
+    ~Task() { reset(); }
+
+    void operator()() { vtable->invoke( storage ); }
+    explicit operator bool() const { return vtable != nullptr; }
+    void reset() {
+      if( vtable ) { vtable->destroy( storage ); vtable = nullptr; }
+    }
+  private:
+    struct VTable {
+      void (*invoke)( void* );
+      void (*move)( void* dst, void* src ); // move constructs dst, destroys src
+      void (*destroy)( void* );
+    };
+    template <typename F>
+    static constexpr bool fits_inline() {
+      return sizeof(F) <= INLINE_SIZE && alignof(F) <= alignof(std::max_align_t)
+	&& std::is_nothrow_move_constructible<F>::value;
+    }
+    template <typename F, typename U>
+    void construct( U&& f ) {
+      if constexpr ( fits_inline<F>() ) {
+	static const VTable table{
+	  []( void* p ) { (*static_cast<F*>( p ))(); },
+	  []( void* dst, void* src ) {
+	    new (dst) F( std::move( *static_cast<F*>( src ) ) );
+	    static_cast<F*>( src )->~F();
+	  },
+	  []( void* p ) { static_cast<F*>( p )->~F(); } };
+	new (storage) F( std::forward<U>( f ) );
+	vtable = &table;
+      } else {
+	static const VTable table{
+	  []( void* p ) { (**static_cast<F**>( p ))(); },
+	  []( void* dst, void* src ) { *static_cast<F**>( dst ) = *static_cast<F**>( src ); },
+	  []( void* p ) { delete *static_cast<F**>( p ); } };
+	*reinterpret_cast<F**>( storage ) = new F( std::forward<U>( f ) );
+	vtable = &table;
+      }
+    }
+    void move_from( Task& other ) {
+      if( other.vtable ) {
+	other.vtable->move( storage, other.storage );
+	vtable = other.vtable;
+	other.vtable = nullptr;
+      }
+    }
+
+    alignas(std::max_align_t) unsigned char storage[INLINE_SIZE];
+    const VTable* vtable = nullptr;
+  };
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Growable circular buffer of Task slots (capacity is a power of two).
+  // Slots are allocated up front and reused; the ring only reallocates when
+  // it is full, doubling its size.
+  ////////////////////////////////////////////////////////////////////////////////
+  class TaskRing {
+  public:
+    explicit TaskRing( size_t Capacity = 256 ) {
+      size_t capacity = 1;
+      while( capacity < Capacity ) capacity <<= 1;
+      slots.reset( new Task[ capacity ] );
+      mask = capacity-1;
+    }
+    bool empty() const { return head == tail; }
+    size_t size() const { return tail-head; }
+    size_t capacity() const { return mask+1; }
+
+    void push_back( Task&& task ) {
+      if( size() == capacity() ) grow();
+      slots[ tail++ & mask ] = std::move( task );
+    }
+    // Both pops assume !empty().
+    void pop_front( Task& task ) { task = std::move( slots[ head++ & mask ] ); }
+    void pop_back( Task& task ) { task = std::move( slots[ --tail & mask ] ); }
+  private:
+    void grow() {
+      const size_t capacity = 2*( mask+1 );
+      std::unique_ptr<Task[]> bigger( new Task[ capacity ] );
+      for( size_t i=0, n=size(); i < n; ++i ) bigger[i] = std::move( slots[ (head+i) & mask ] );
+      tail = size();
+      head = 0;
+      slots = std::move( bigger );
+      mask = capacity-1;
+    }
+
+    std::unique_ptr<Task[]> slots;
+    size_t mask = 0;
+    size_t head = 0, tail = 0; // free running, indexed modulo capacity
+  };
+
   class ThreadPool {
   private:
+    static constexpr unsigned int NO_SLOT = ~0u;
+    // Per worker deque, padded to a cache line so neighbouring owners do not
+    // false share the lock word.
+    struct alignas(64) WorkerQueue {
+      std::mutex mutex;
+      TaskRing tasks[PRIORITY_LANES];
+    };
+    // Identity of the calling thread: which pool (if any) it works for and
+    // which deque it owns.
+    struct WorkerIdentity {
+      const ThreadPool* pool;
+      unsigned int slot;
+    };
+    static WorkerIdentity& this_worker() {
+      static thread_local WorkerIdentity id{ nullptr, NO_SLOT };
+      return id;
+    }
+    // Thread owned by the pool; retire asks it to leave after its current task.
+    struct Worker {
+      std::atomic<bool> retire{false};
+      std::thread thread;
+    };
+
     const unsigned int MAX_THREADS = 8;
-    std::queue< std::function<void()> > task_queue;
+    const SCHEDULING MODE = SCHEDULING::GLOBAL_QUEUE;
+    const PLACEMENT PLACE = PLACEMENT::NONE;
+    TaskRing task_queue[PRIORITY_LANES];
     std::mutex mutex;
     std::condition_variable condition_variable;
     std::atomic<bool> work;
+    std::unique_ptr<WorkerQueue[]> worker_queues;
+    std::atomic<unsigned int> next_victim{0};
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> lane_queued[PRIORITY_LANES] = {};
+    std::atomic<unsigned int> sleepers{0};
+    std::atomic<unsigned int> spin{1024};
+    std::vector<bool> slot_used;
+    std::mutex slot_mutex;
+    std::vector< std::unique_ptr<Worker> > workers;
+    std::mutex workers_mutex; // serialises start/resize/destruction
+    PoolStats statistics;
+    CpuTopology topology;
+    std::vector< std::vector<unsigned int> > slot_cpus;   // affinity per slot
+    std::vector<unsigned int> slot_node;                   // node per slot
+    std::vector< std::vector<unsigned int> > node_slots;  // slots per node
+    std::vector< std::vector<unsigned int> > steal_order; // victims per slot, NO_SLOT last
+
+    unsigned int local_slot() const {
+      const WorkerIdentity& id = this_worker();
+      return ( id.pool == this ) ? id.slot : NO_SLOT;
+    }
+    // Lowest free deque slot; callers beyond MAX_THREADS get NO_SLOT and
+    // only steal.
+    unsigned int acquire_slot() {
+      std::unique_lock<std::mutex> lock{ slot_mutex };
+      auto it = std::find( slot_used.begin(), slot_used.end(), false );
+      if( it == slot_used.end() ) return NO_SLOT;
+      *it = true;
+      return static_cast<unsigned int>( it-slot_used.begin() );
+    }
+    void release_slot( unsigned int slot ) {
+      if( slot == NO_SLOT ) return;
+      std::unique_lock<std::mutex> lock{ slot_mutex };
+      slot_used[slot] = false;
+    }
+    // Poll for work without the lock before parking.
+    bool spin_for_work( const std::atomic<bool>* retire ) const {
+      for( unsigned int i=0, n=spin.load( std::memory_order_relaxed ); i < n; ++i ) {
+	if( queued.load( std::memory_order_relaxed ) > 0 || !work.load( std::memory_order_relaxed ) ) return true;
+	if( retire && retire->load( std::memory_order_relaxed ) ) return true;
+	cpu_relax();
+      }
+      return false;
+    }
+    // Lock, charging any wait to the caller's stats slot.
+    std::unique_lock<std::mutex> timed_lock( std::mutex& m ) {
+      if constexpr ( !PoolStats::ENABLED ) {
+	return std::unique_lock<std::mutex>{ m };
+      } else {
+	std::unique_lock<std::mutex> lock{ m, std::try_to_lock };
+	if( lock.owns_lock() ) return lock;
+	const uint64_t start = statistics.now();
+	lock.lock();
+	statistics.lock_wait( worker_index(), statistics.now()-start );
+	return lock;
+      }
+    }
+    void setup_placement();
+    template <typename F>
+    Task make_task( F&& f ) {
+      if constexpr ( PoolStats::ENABLED ) {
+	return Task( [ this, enqueued = statistics.now(), func = std::forward<F>( f ) ]() mutable {
+	    const uint64_t start = statistics.now();
+	    func();
+	    statistics.task_done( worker_index(), enqueued, start, statistics.now() );
+	  } );
+      } else {
+	return Task( std::forward<F>( f ) );
+      }
+    }
+    void add_tasks( Task* tasks, size_t n, PRIORITY priority );
+    void wake( size_t n );
+    bool pop_global( Task& func ); // mutex held
+    bool pop_task( unsigned int slot, Task& func );
+    void run_worker( const std::atomic<bool>* retire );
+    void run_global_queue( const std::atomic<bool>* retire );
+    void run_work_stealing( unsigned int slot, const std::atomic<bool>* retire );
   public:
-    ThreadPool(unsigned int MaxThreads): MAX_THREADS{MaxThreads},work{true} {}
+    static unsigned int default_thread_count() {
+      return std::max( 1u, std::thread::hardware_concurrency() );
+    }
+    ThreadPool(unsigned int MaxThreads, SCHEDULING Mode = SCHEDULING::GLOBAL_QUEUE,
+	       PLACEMENT Placement = PLACEMENT::NONE):
+      MAX_THREADS{MaxThreads}, MODE{Mode}, PLACE{Placement}, work{true}, slot_used( MaxThreads, false ),
+      statistics( MaxThreads+1 ),
+      topology{ Placement == PLACEMENT::NONE ? CpuTopology::single_node() : CpuTopology::discover() } {
+      assert( MAX_THREADS > 0 );
+      if( MODE == SCHEDULING::WORK_STEALING )
+	worker_queues.reset( new WorkerQueue[ MAX_THREADS ] );
+      setup_placement();
+    }
+    explicit ThreadPool(SCHEDULING Mode = SCHEDULING::GLOBAL_QUEUE, PLACEMENT Placement = PLACEMENT::NONE):
+      ThreadPool( default_thread_count(), Mode, Placement ) {}
     ThreadPool( const ThreadPool& ) = delete;
     ThreadPool& operator=( const ThreadPool& ) = delete;
     ThreadPool( ThreadPool&& ) = delete;
+    // Owned workers drain the queue and are joined; external run() threads
+    // must already have been joined by their owner.
+    ~ThreadPool() {
+      std::unique_lock<std::mutex> lock{ workers_mutex };
+      if( workers.empty() ) return;
+      complete();
+      for( auto& w : workers ) w->thread.join();
+    }
+
+    // Spawn owned workers; N == 0 means MAX_THREADS.
+    void start( unsigned int N = 0 ) { resize( N ? N : MAX_THREADS ); }
+    // Grow or shrink the owned worker set to N (at most MAX_THREADS). Retired
+    // workers finish their current task; tasks left on their deques are
+    // stolen by the others.
+    void resize( unsigned int N );
+    unsigned int size() {
+      std::unique_lock<std::mutex> lock{ workers_mutex };
+      return static_cast<unsigned int>( workers.size() );
+    }
+    // Number of lock free polls an idle worker makes before it parks.
+    void spin_limit( unsigned int N ) { spin = N; }
+    unsigned int spin_limit() const { return spin; }
 
-    void add( std::function<void()> f) {
+    SCHEDULING scheduling() const { return MODE; }
+    PLACEMENT placement() const { return PLACE; }
+    const CpuTopology& cpu_topology() const { return topology; }
+    // NUMA node (index into cpu_topology()) that slot is placed on.
+    unsigned int node_of_slot( unsigned int slot ) const { return slot_node[slot]; }
+    unsigned int max_threads() const { return MAX_THREADS; }
+    // Deque slot of the calling worker in [0,MAX_THREADS), or MAX_THREADS for
+    // threads that are not (slotted) workers of this pool.
+    unsigned int worker_index() const {
+      unsigned int slot = local_slot();
+      return ( slot == NO_SLOT ) ? MAX_THREADS : slot;
+    }
+
+    template <typename F>
+    void add( F&& f, PRIORITY priority = PRIORITY::NORMAL ) {
       assert( work && "Queue is shut down." );
-      {
-	std::unique_lock<std::mutex> lock{ mutex };
-	task_queue.emplace( f );
+      Task task = make_task( std::forward<F>( f ) );
+      add_tasks( &task, 1, priority );
+    }
+
+    // Tasks built and enqueued per add_tasks() call by add_batch()/add_range().
+    static constexpr size_t BATCH_CHUNK = 4096;
+
+    // Enqueue every callable in [first,last) (moved from), BATCH_CHUNK at a time.
+    template <typename It>
+    void add_batch( It first, It last, PRIORITY priority = PRIORITY::NORMAL ) {
+      assert( work && "Queue is shut down." );
+      std::vector<Task> batch;
+      batch.reserve( std::min<size_t>( BATCH_CHUNK, std::distance( first, last ) ) );
+      for( ; first != last; ++first ) {
+	batch.push_back( make_task( std::move( *first ) ) );
+	if( batch.size() == BATCH_CHUNK ) {
+	  add_tasks( batch.data(), batch.size(), priority );
+	  batch.clear();
+	}
       }
-      condition_variable.notify_one();
+      add_tasks( batch.data(), batch.size(), priority );
+    }
+
+    // One task per index: f(i) for i in [first,last), f shared by all of them.
+    template <typename F>
+    void add_range( size_t first, size_t last, F&& f, PRIORITY priority = PRIORITY::NORMAL ) {
+      assert( work && "Queue is shut down." );
+      if( first >= last ) return;
+      auto shared = std::make_shared< std::decay_t<F> >( std::forward<F>( f ) );
+      std::vector<Task> batch;
+      batch.reserve( std::min( BATCH_CHUNK, last-first ) );
+      for( size_t lo=first, hi; lo < last; lo = hi ) {
+	hi = lo + std::min( BATCH_CHUNK, last-lo );
+	batch.clear();
+	for( size_t i=lo; i < hi; ++i ) batch.push_back( make_task( [shared,i]() { (*shared)( i ); } ) );
+	add_tasks( batch.data(), batch.size(), priority );
+      }
+    }
+
+    template <typename F, typename... Args>
+    auto submit( F&& f, Args&&... args )
+      -> std::future< std::invoke_result_t< std::decay_t<F>, std::decay_t<Args>... > > {
+      using R = std::invoke_result_t< std::decay_t<F>, std::decay_t<Args>... >;
+      std::packaged_task<R()> task(
+	[ func = std::forward<F>( f ), tuple = std::make_tuple( std::forward<Args>( args )... ) ]() mutable -> R {
+	  return std::apply( std::move( func ), std::move( tuple ) );
+	} );
+      std::future<R> result = task.get_future();
+      add( std::move( task ) );
+      return result;
     }
-      
+
+    // Run one queued task on the calling thread, if any. Threads that wait on
+    // work they submitted should help this way instead of blocking, so nested
+    // waits cannot starve the pool (see help_while and TaskGroup).
+    bool try_run_one();
+    template <typename Pred>
+    void help_while( Pred pending ) {
+      while( pending() ) {
+	if( !try_run_one() ) std::this_thread::yield();
+      }
+    }
+
     void complete() {
       {
 	std::unique_lock<std::mutex> lock{ mutex };
@@ -48,23 +427,367 @@ namespace THREAD_POOL {
       condition_variable.notify_all();
     }
 
-    void run() {
-      while( true ) {
-	std::function<void()> func;
-	{
-	  std::unique_lock<std::mutex> lock{mutex};
-	  condition_variable.wait(lock, [this]() {return !task_queue.empty() || !work; });
-	  if (!work && task_queue.empty())
-	    {
-	      return;
-	    }
-	  func = task_queue.front();
-	  task_queue.pop();
+    void run() { run_worker( nullptr ); }
+
+    // Instrumentation; empty/no-op unless built with -DTHREAD_POOL_STATS.
+    // stats() is indexed by worker_index().
+    std::vector<WorkerStats> stats() const { return statistics.snapshot(); }
+    void reset_stats() { statistics.reset(); }
+    void tracing( bool on ) { statistics.tracing( on ); }
+    void write_trace( std::ostream& os ) const { statistics.write_trace( os ); }
+
+  };
+
+  // Blocks until every future is ready and returns the results in order. Do
+  // not call from inside a task of the same pool: the waiting worker cannot
+  // run the tasks it waits for.
+  template <typename R>
+  std::vector<R> when_all( std::vector< std::future<R> >& futures )
+  {
+    std::vector<R> retval;
+    retval.reserve( futures.size() );
+    for( auto& f : futures ) retval.push_back( f.get() );
+    return retval;
+  }
+
+  inline void when_all( std::vector< std::future<void> >& futures )
+  {
+    for( auto& f : futures ) f.get();
+  }
+
+  template <typename R, typename T, typename Op>
+  T reduce( std::vector< std::future<R> >& futures, T init, Op op )
+  {
+    for( auto& f : futures ) init = op( std::move( init ), f.get() );
+    return init;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  // Streaming reduction: each submitted task's result is folded into the
+  // partial of the worker that ran it, get() waits for the outstanding tasks
+  // and folds the partials. Op must be associative; partials are combined in
+  // worker order, not submission order.
+  ////////////////////////////////////////////////////////////////////////////////
+  template <typename R, typename Op = std::plus<R>>
+  class Reduction {
+  public:
+    Reduction( ThreadPool& Pool, R Init, Op Operation = Op{} ):
+      pool{Pool}, init{std::move(Init)}, op{std::move(Operation)},
+      partials( Pool.max_threads()+1 ), pending{0} {}
+    Reduction( const Reduction& ) = delete;
+    Reduction& operator=( const Reduction& ) = delete;
+
+    template <typename F, typename... Args>
+    void submit( F&& f, Args&&... args ) {
+      pending.fetch_add( 1 );
+      pool.add( [ this, func = std::forward<F>( f ), tuple = std::make_tuple( std::forward<Args>( args )... ) ]() mutable {
+	  try {
+	    accumulate( std::apply( func, tuple ) );
+	  } catch( ... ) {
+	    std::unique_lock<std::mutex> lock{ mutex };
+	    if( !error ) error = std::current_exception();
+	  }
+	  finish();
+	} );
+    }
+
+    // One task per index, f(i) for i in [first,last), enqueued in batches.
+    template <typename F>
+    void submit_range( size_t first, size_t last, F f ) {
+      if( first >= last ) return;
+      pending.fetch_add( last-first );
+      pool.add_range( first, last, [ this, func = std::move( f ) ]( size_t i ) {
+	  try {
+	    accumulate( func( i ) );
+	  } catch( ... ) {
+	    std::unique_lock<std::mutex> lock{ mutex };
+	    if( !error ) error = std::current_exception();
+	  }
+	  finish();
+	} );
+    }
+
+    // Waits for every task submitted so far; rethrows the first task exception.
+    R get() {
+      {
+	std::unique_lock<std::mutex> lock{ mutex };
+	done.wait( lock, [this]() { return pending.load() == 0; } );
+	if( error ) std::rethrow_exception( error );
+      }
+      R retval = init;
+      for( auto& p : partials ) {
+	std::unique_lock<std::mutex> lock{ p.mutex };
+	if( p.value ) retval = op( std::move( retval ), *p.value );
+      }
+      return retval;
+    }
+  private:
+    struct alignas(64) Partial {
+      std::mutex mutex; // only contended by non-worker threads sharing the last slot
+      std::optional<R> value;
+    };
+    void accumulate( R value ) {
+      Partial& p = partials[ pool.worker_index() ];
+      std::unique_lock<std::mutex> lock{ p.mutex };
+      if( p.value ) p.value = op( std::move( *p.value ), std::move( value ) );
+      else p.value = std::move( value );
+    }
+    // The last task drops pending to zero under the mutex, so get() cannot
+    // return (and the Reduction die) while a finishing task still touches it.
+    void finish() {
+      size_t n = pending.load();
+      while( n > 1 ) {
+	if( pending.compare_exchange_weak( n, n-1 ) ) return;
+      }
+      std::unique_lock<std::mutex> lock{ mutex };
+      if( pending.fetch_sub( 1 ) == 1 ) done.notify_all();
+    }
+
+    ThreadPool& pool;
+    const R init;
+    Op op;
+    std::vector<Partial> partials;
+    std::atomic<size_t> pending;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+  };
+
+  inline void ThreadPool::resize( unsigned int N )
+  {
+    assert( N <= MAX_THREADS && "Pool cannot grow beyond MAX_THREADS." );
+    std::unique_lock<std::mutex> lock{ workers_mutex };
+    while( workers.size() < N ) {
+      workers.emplace_back( new Worker );
+      Worker& w = *workers.back();
+      w.thread = std::thread( &ThreadPool::run_worker, this, &w.retire );
+    }
+    if( workers.size() == N ) return;
+    for( size_t i=N; i < workers.size(); ++i ) workers[i]->retire = true;
+    { std::unique_lock<std::mutex> lock{ mutex }; }
+    condition_variable.notify_all();
+    for( size_t i=N; i < workers.size(); ++i ) workers[i]->thread.join();
+    workers.resize( N );
+  }
+
+  inline void ThreadPool::add_tasks( Task* tasks, size_t n, PRIORITY priority )
+  {
+    if( n == 0 ) return;
+    const unsigned int lane = static_cast<unsigned int>( priority );
+    if( MODE == SCHEDULING::GLOBAL_QUEUE ) {
+      size_t parked;
+      {
+	std::unique_lock<std::mutex> lock = timed_lock( mutex );
+	for( size_t i=0; i < n; ++i ) task_queue[lane].push_back( std::move( tasks[i] ) );
+	lane_queued[lane].fetch_add( n );
+	queued.fetch_add( n );
+	parked = sleepers.load();
+	statistics.queue_depth( worker_index(), task_queue[lane].size() );
+      }
+      // sleepers was read under the mutex, so no extra handshake is needed.
+      if( n >= parked ) condition_variable.notify_all();
+      else for( size_t i=0; i < n; ++i ) condition_variable.notify_one();
+      return;
+    }
+    // Count first so a worker never sees an empty pool while a task is in
+    // flight; pairs with the sleepers check in wake() (both seq_cst).
+    lane_queued[lane].fetch_add( n );
+    queued.fetch_add( n );
+    // Workers push onto their own deque. Outside threads spread the batch in
+    // contiguous blocks over the deques, starting round robin (over the
+    // deques of their current node when placement is on).
+    unsigned int slot = local_slot();
+    if( slot != NO_SLOT ) {
+      std::unique_lock<std::mutex> lock = timed_lock( worker_queues[slot].mutex );
+      for( size_t i=0; i < n; ++i ) worker_queues[slot].tasks[lane].push_back( std::move( tasks[i] ) );
+      statistics.queue_depth( worker_index(), worker_queues[slot].tasks[lane].size() );
+    } else {
+      const std::vector<unsigned int>* local = nullptr;
+      if( PLACE != PLACEMENT::NONE ) {
+	local = &node_slots[ topology.node_of( current_cpu() ) ];
+	if( local->empty() ) local = nullptr;
+      }
+      const size_t targets = local ? local->size() : MAX_THREADS;
+      const size_t blocks = std::min( n, targets );
+      const unsigned int next = next_victim.fetch_add( static_cast<unsigned int>( blocks ), std::memory_order_relaxed );
+      for( size_t b=0, done=0; b < blocks; ++b ) {
+	const size_t target = ( next+b ) % targets;
+	const unsigned int victim = local ? (*local)[target] : static_cast<unsigned int>( target );
+	const size_t end = n*(b+1)/blocks;
+	std::unique_lock<std::mutex> lock = timed_lock( worker_queues[victim].mutex );
+	for( ; done < end; ++done ) worker_queues[victim].tasks[lane].push_back( std::move( tasks[done] ) );
+	statistics.queue_depth( worker_index(), worker_queues[victim].tasks[lane].size() );
+      }
+    }
+    wake( n );
+  }
+
+  // Wake up to n parked workers.
+  inline void ThreadPool::wake( size_t n )
+  {
+    const size_t parked = sleepers.load();
+    if( parked == 0 ) return;
+    { std::unique_lock<std::mutex> lock{ mutex }; }
+    if( n >= parked ) condition_variable.notify_all();
+    else for( size_t i=0; i < n; ++i ) condition_variable.notify_one();
+  }
+
+  inline bool ThreadPool::try_run_one()
+  {
+    Task func;
+    if( MODE == SCHEDULING::GLOBAL_QUEUE ) {
+      if( queued.load( std::memory_order_relaxed ) == 0 ) return false;
+      std::unique_lock<std::mutex> lock{ mutex };
+      if( !pop_global( func ) ) return false;
+    } else if( !pop_task( local_slot(), func ) ) {
+      return false;
+    }
+    func();
+    return true;
+  }
+
+  // Spread slots evenly over the node-major CPU list, so a pool smaller than
+  // the machine still covers every node.
+  inline void ThreadPool::setup_placement()
+  {
+    const std::vector<unsigned int> cpus = topology.cpus();
+    const size_t NCPU = cpus.size();
+    slot_cpus.resize( MAX_THREADS );
+    slot_node.resize( MAX_THREADS );
+    node_slots.assign( topology.node_count(), {} );
+    for( unsigned int s=0; s < MAX_THREADS; ++s ) {
+      const unsigned int cpu = cpus[ ( MAX_THREADS <= NCPU ) ? s*NCPU/MAX_THREADS : s % NCPU ];
+      slot_node[s] = static_cast<unsigned int>( topology.node_of( cpu ) );
+      node_slots[ slot_node[s] ].push_back( s );
+      if( PLACE == PLACEMENT::CORES ) slot_cpus[s] = { cpu };
+      else if( PLACE == PLACEMENT::NUMA_NODES ) slot_cpus[s] = topology.node_cpus( slot_node[s] );
+    }
+    // Victims: same node first, then the rest, each cyclic from slot+1.
+    steal_order.assign( MAX_THREADS+1, {} );
+    for( unsigned int s=0; s <= MAX_THREADS; ++s ) {
+      std::vector<unsigned int>& order = steal_order[s];
+      for( unsigned int i=0; i < MAX_THREADS; ++i ) {
+	const unsigned int v = ( s+1+i ) % ( MAX_THREADS+1 );
+	if( v != MAX_THREADS && v != s ) order.push_back( v );
+      }
+      if( PLACE != PLACEMENT::NONE && s < MAX_THREADS ) {
+	std::stable_partition( order.begin(), order.end(),
+			       [this,s]( unsigned int v ) { return slot_node[v] == slot_node[s]; } );
+      }
+    }
+  }
+
+  inline void ThreadPool::run_worker( const std::atomic<bool>* retire )
+  {
+    const unsigned int slot = acquire_slot();
+    WorkerIdentity saved = this_worker();
+    this_worker() = WorkerIdentity{ this, slot };
+    std::vector<unsigned int> original_affinity;
+    if( PLACE != PLACEMENT::NONE && slot != NO_SLOT ) {
+      original_affinity = current_affinity();
+      set_affinity( slot_cpus[slot] );
+    }
+    if( MODE == SCHEDULING::GLOBAL_QUEUE ) run_global_queue( retire );
+    else run_work_stealing( slot, retire );
+    if( !original_affinity.empty() ) set_affinity( original_affinity );
+    this_worker() = saved;
+    release_slot( slot );
+  }
+
+  inline void ThreadPool::run_global_queue( const std::atomic<bool>* retire )
+  {
+    auto retiring = [retire]() { return retire && retire->load(); };
+    while( true ) {
+      Task func;
+      const uint64_t idle_start = statistics.now();
+      const bool was_idle = queued.load( std::memory_order_relaxed ) == 0;
+      if( was_idle ) spin_for_work( retire );
+      {
+	std::unique_lock<std::mutex> lock = timed_lock( mutex );
+	if( queued.load() == 0 && work && !retiring() ) {
+	  ++sleepers;
+	  condition_variable.wait(lock, [&]() {return queued.load() > 0 || !work || retiring(); });
+	  --sleepers;
 	}
+	if( was_idle ) statistics.idle( worker_index(), idle_start, statistics.now() );
+	if( retiring() ) return;
+	if (!work && queued.load() == 0)
+	  {
+	    return;
+	  }
+	pop_global( func );
+      }
+      func();
+    }
+  }
+
+  // Highest non-empty lane of the global queue; caller holds mutex.
+  inline bool ThreadPool::pop_global( Task& func )
+  {
+    for( unsigned int lane=0; lane < PRIORITY_LANES; ++lane ) {
+      if( task_queue[lane].empty() ) continue;
+      task_queue[lane].pop_front( func );
+      lane_queued[lane].fetch_sub( 1 );
+      queued.fetch_sub( 1 );
+      return true;
+    }
+    return false;
+  }
+
+  // Per lane, highest first: own deque (back), then steal from the front of
+  // the others. Lanes with nothing queued anywhere are skipped unlocked.
+  inline bool ThreadPool::pop_task( unsigned int slot, Task& func )
+  {
+    for( unsigned int lane=0; lane < PRIORITY_LANES; ++lane ) {
+      if( lane_queued[lane].load( std::memory_order_relaxed ) == 0 ) continue;
+      if( slot != NO_SLOT ) {
+	WorkerQueue& own = worker_queues[slot];
+	std::unique_lock<std::mutex> lock = timed_lock( own.mutex );
+	if( !own.tasks[lane].empty() ) {
+	  own.tasks[lane].pop_back( func );
+	  lane_queued[lane].fetch_sub( 1 );
+	  queued.fetch_sub( 1 );
+	  return true;
+	}
+      }
+      for( unsigned int v : steal_order[ ( slot == NO_SLOT ) ? MAX_THREADS : slot ] ) {
+	WorkerQueue& victim = worker_queues[v];
+	std::unique_lock<std::mutex> lock{ victim.mutex, std::try_to_lock };
+	if( !lock.owns_lock() || victim.tasks[lane].empty() ) continue;
+	victim.tasks[lane].pop_front( func );
+	lane_queued[lane].fetch_sub( 1 );
+	queued.fetch_sub( 1 );
+	return true;
+      }
+    }
+    return false;
+  }
+
+  inline void ThreadPool::run_work_stealing( unsigned int slot, const std::atomic<bool>* retire )
+  {
+    auto retiring = [retire]() { return retire && retire->load(); };
+    Task func;
+    uint64_t idle_start = 0;
+    bool idle = false;
+    while( !retiring() ) {
+      if( pop_task( slot, func ) ) {
+	if( idle ) statistics.idle( worker_index(), idle_start, statistics.now() );
+	idle = false;
 	func();
+	func.reset();
+	continue;
       }
+      if( !idle ) { idle = true; idle_start = statistics.now(); }
+      // A try_lock miss can leave work behind; only sleep when nothing is queued.
+      if( queued.load() > 0 ) { std::this_thread::yield(); continue; }
+      if( !work ) break;
+      if( spin_for_work( retire ) ) continue;
+      std::unique_lock<std::mutex> lock{ mutex };
+      ++sleepers;
+      condition_variable.wait( lock, [&]() { return queued.load() > 0 || !work || retiring(); } );
+      --sleepers;
     }
-      
-  };
+    if( idle ) statistics.idle( worker_index(), idle_start, statistics.now() );
+  }
 
 } // end of namespace THREAD_POOL
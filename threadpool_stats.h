@@ -0,0 +1,192 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : threadpool_stats.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Scheduler counters and Chrome trace export for ThreadPool
+//
+// Compile with -DTHREAD_POOL_STATS to enable. Without it PoolStats is an
+// empty class whose hooks are no-ops, ThreadPool::add() does not wrap tasks
+// and no clock is read, so the instrumentation costs nothing.
+//
+// Per worker slot (slot MAX_THREADS collects non-worker threads):
+// tasks executed, idle time (spinning or parked), time blocked on pool locks,
+// deepest queue seen on push, and a log2(ns) histogram of task latency from
+// add() to completion. With tracing on, every task and idle period is also
+// logged and write_trace() emits Chrome trace JSON (chrome://tracing or
+// ui.perfetto.dev).
+////////////////////////////////////////////////////////////////////////////////
+
+#include <array>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+#pragma once
+
+namespace THREAD_POOL {
+
+  struct WorkerStats {
+    static constexpr unsigned int BUCKETS = 40; // bucket b: latency in [2^b, 2^(b+1)) ns
+    uint64_t tasks = 0;
+    uint64_t idle_ns = 0;
+    uint64_t lock_wait_ns = 0;
+    uint64_t queue_high_water = 0;
+    std::array<uint64_t, BUCKETS> latency_histogram{};
+  };
+
+#ifdef THREAD_POOL_STATS
+
+  class PoolStats {
+  public:
+    static constexpr bool ENABLED = true;
+    explicit PoolStats( unsigned int Slots ): slots{ new Slot[Slots] }, count{Slots},
+					     epoch{ std::chrono::steady_clock::now() } {}
+
+    uint64_t now() const {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now()-epoch ).count();
+    }
+    void task_done( unsigned int slot, uint64_t enqueued, uint64_t start, uint64_t end ) {
+      Slot& s = slots[slot];
+      s.tasks.fetch_add( 1, std::memory_order_relaxed );
+      const uint64_t latency = end-enqueued;
+      unsigned int bucket = 0;
+      while( bucket+1 < WorkerStats::BUCKETS && ( latency >> (bucket+1) ) ) ++bucket;
+      s.histogram[bucket].fetch_add( 1, std::memory_order_relaxed );
+      if( tracing_on.load( std::memory_order_relaxed ) ) log( s, TraceEvent{ start, end-start, start-enqueued, true } );
+    }
+    void idle( unsigned int slot, uint64_t start, uint64_t end ) {
+      Slot& s = slots[slot];
+      s.idle_ns.fetch_add( end-start, std::memory_order_relaxed );
+      if( tracing_on.load( std::memory_order_relaxed ) ) log( s, TraceEvent{ start, end-start, 0, false } );
+    }
+    void lock_wait( unsigned int slot, uint64_t ns ) {
+      slots[slot].lock_wait_ns.fetch_add( ns, std::memory_order_relaxed );
+    }
+    void queue_depth( unsigned int slot, size_t depth ) {
+      std::atomic<uint64_t>& hw = slots[slot].high_water;
+      uint64_t seen = hw.load( std::memory_order_relaxed );
+      while( depth > seen && !hw.compare_exchange_weak( seen, depth, std::memory_order_relaxed ) ) {}
+    }
+
+    void tracing( bool on ) { tracing_on = on; }
+    std::vector<WorkerStats> snapshot() const;
+    void reset();
+    void write_trace( std::ostream& os ) const;
+  private:
+    struct TraceEvent {
+      uint64_t start, duration, queued; // ns since epoch / ns
+      bool task;                        // task or idle period
+    };
+    struct alignas(64) Slot {
+      std::atomic<uint64_t> tasks{0}, idle_ns{0}, lock_wait_ns{0}, high_water{0};
+      std::array<std::atomic<uint64_t>, WorkerStats::BUCKETS> histogram{};
+      mutable std::mutex trace_mutex; // uncontended except on the non-worker slot
+      std::vector<TraceEvent> events;
+    };
+    static void log( Slot& s, const TraceEvent& e ) {
+      std::unique_lock<std::mutex> lock{ s.trace_mutex };
+      s.events.push_back( e );
+    }
+
+    std::unique_ptr<Slot[]> slots;
+    const unsigned int count;
+    const std::chrono::steady_clock::time_point epoch;
+    std::atomic<bool> tracing_on{false};
+  };
+
+  inline std::vector<WorkerStats> PoolStats::snapshot() const
+  {
+    std::vector<WorkerStats> retval( count );
+    for( unsigned int i=0; i < count; ++i ) {
+      const Slot& s = slots[i];
+      retval[i].tasks = s.tasks.load();
+      retval[i].idle_ns = s.idle_ns.load();
+      retval[i].lock_wait_ns = s.lock_wait_ns.load();
+      retval[i].queue_high_water = s.high_water.load();
+      for( unsigned int b=0; b < WorkerStats::BUCKETS; ++b ) retval[i].latency_histogram[b] = s.histogram[b].load();
+    }
+    return retval;
+  }
+
+  inline void PoolStats::reset()
+  {
+    for( unsigned int i=0; i < count; ++i ) {
+      Slot& s = slots[i];
+      s.tasks = 0; s.idle_ns = 0; s.lock_wait_ns = 0; s.high_water = 0;
+      for( auto& h : s.histogram ) h = 0;
+      std::unique_lock<std::mutex> lock{ s.trace_mutex };
+      s.events.clear();
+    }
+  }
+
+  inline void PoolStats::write_trace( std::ostream& os ) const
+  {
+    const std::ios::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    os << "{\"traceEvents\":[\n";
+    bool first = true;
+    for( unsigned int i=0; i < count; ++i ) {
+      std::unique_lock<std::mutex> lock{ slots[i].trace_mutex };
+      os << ( first ? "" : ",\n" ) << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i
+	 << ",\"args\":{\"name\":\"" << ( i+1 == count ? "external" : "worker " + std::to_string( i ) ) << "\"}}";
+      first = false;
+      for( const auto& e : slots[i].events ) {
+	os << ",\n{\"name\":\"" << ( e.task ? "task" : "idle" ) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << i
+	   << std::fixed << std::setprecision(3)
+	   << ",\"ts\":" << e.start*1e-3 << ",\"dur\":" << e.duration*1e-3;
+	if( e.task ) os << ",\"args\":{\"queued_us\":" << e.queued*1e-3 << "}";
+	os << "}";
+      }
+    }
+    os << "\n]}\n";
+    os.flags( flags );
+    os.precision( precision );
+  }
+
+#else
+
+  class PoolStats {
+  public:
+    static constexpr bool ENABLED = false;
+    explicit PoolStats( unsigned int ) {}
+    uint64_t now() const { return 0; }
+    void task_done( unsigned int, uint64_t, uint64_t, uint64_t ) {}
+    void idle( unsigned int, uint64_t, uint64_t ) {}
+    void lock_wait( unsigned int, uint64_t ) {}
+    void queue_depth( unsigned int, size_t ) {}
+    void tracing( bool ) {}
+    std::vector<WorkerStats> snapshot() const { return {}; }
+    void reset() {}
+    void write_trace( std::ostream& os ) const { os << "{\"traceEvents\":[]}\n"; }
+  };
+
+#endif // THREAD_POOL_STATS
+
+  // One line per slot that did anything, plus the median latency bucket.
+  inline void write_stats( std::ostream& os, const std::vector<WorkerStats>& stats )
+  {
+    if( stats.empty() ) { os << "ThreadPool statistics not compiled in (-DTHREAD_POOL_STATS)." << std::endl; return; }
+    os << std::setw(8) << "WORKER" << std::setw(12) << "TASKS" << std::setw(12) << "IDLE ms"
+       << std::setw(12) << "LOCK ms" << std::setw(12) << "MAX QUEUE" << std::setw(16) << "MEDIAN LAT ns" << "\n";
+    for( size_t i=0; i < stats.size(); ++i ) {
+      const WorkerStats& w = stats[i];
+      if( w.tasks == 0 && w.idle_ns == 0 && w.queue_high_water == 0 ) continue;
+      uint64_t seen = 0;
+      unsigned int median = 0;
+      for( ; median < WorkerStats::BUCKETS; ++median ) {
+	seen += w.latency_histogram[median];
+	if( 2*seen >= w.tasks ) break;
+      }
+      os << std::setw(8) << ( i+1 == stats.size() ? std::string("ext") : std::to_string( i ) )
+	 << std::setw(12) << w.tasks << std::setw(12) << w.idle_ns*1e-6 << std::setw(12) << w.lock_wait_ns*1e-6
+	 << std::setw(12) << w.queue_high_water << std::setw(16) << ( w.tasks ? ( 1ull << median ) : 0 ) << "\n";
+    }
+    os << std::flush;
+  }
+
+} // end of namespace THREAD_POOL
@@ -0,0 +1,237 @@
+////////////////////////////////////////////////////////////////////////////////
+// File   : vegas.h
+// Author : Sandeep Koranne (C) 2020. All rights reserved.
+// Purpose: Adaptive importance and stratified sampling (VEGAS, Lepage 1978)
+//        : for 1-D and d-dimensional integrands over a box.
+//
+// Each axis of the box carries a grid of BINS bins of varying width. A
+// uniform y in [0,1)^d lands in one bin per axis and is mapped linearly
+// inside it, so narrow bins get as many samples as wide ones: the sampling
+// density is the product of the 1/width of the bins. The integrand is
+// weighted by the jacobian of that map, and each pass accumulates
+// (J f)^2 per bin and axis. Between passes the bins are moved so each one
+// holds an equal share of that weight (smoothed, and damped by alpha), which
+// concentrates the samples where |f| is large -- the peaks that sample
+// reject MCI wastes its samples around.
+//
+// On top of the grid, y space is cut into ns^d equal hypercubes (ns as
+// large as leaves 2 samples per cube) that all get the same number of
+// samples: stratified sampling. With d large ns is 1 and only the grid is
+// left.
+//
+// A pass runs its samples in parallel on a ThreadPool. Sample i of pass
+// p uses Philox stream p of the seed and the per chunk sums are folded in
+// chunk order, so results do not depend on the number of threads. The
+// passes of integrate() are combined weighted by their inverse variance;
+// chi2_dof well above 1 means the grid was still moving, run adapt() first.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef VEGAS_H
+#define VEGAS_H
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "philox.h"
+#include "parallel_algorithms.h"
+
+namespace MonteCarloIntegration {
+
+  struct VegasResult {
+    double estimate;       // inverse variance weighted mean of the passes
+    double std_error;
+    double chi2_dof;       // consistency of the passes, about 1 if converged
+    unsigned int iterations;
+    uint64_t evaluations;
+  };
+
+  class Vegas
+  {
+  public:
+    Vegas( const std::vector<double>& Lower, const std::vector<double>& Upper, unsigned int Bins = 50,
+	   uint64_t Seed = 1, double Alpha = 1.5 ):
+      lower{Lower}, upper{Upper}, d{ static_cast<unsigned int>( Lower.size() ) }, BINS{Bins},
+      alpha{Alpha}, seed{Seed}, edges( d*(Bins+1) ) {
+      assert( lower.size() == upper.size() && d > 0 && BINS > 1 );
+      for( unsigned int j=0; j < d; ++j )
+	for( unsigned int i=0; i <= BINS; ++i ) edges[j*(BINS+1)+i] = double(i)/BINS;
+    }
+    Vegas( double A, double B, unsigned int Bins = 50, uint64_t Seed = 1, double Alpha = 1.5 ):
+      Vegas( std::vector<double>{A}, std::vector<double>{B}, Bins, Seed, Alpha ) {}
+
+    unsigned int dimension() const { return d; }
+    // Bin edge i of axis j, in [0,1] box coordinates.
+    double edge( unsigned int j, unsigned int i ) const { return edges[j*(BINS+1)+i]; }
+
+    // f is double( const double* x ), or double( double ) when d == 1.
+    // adapt() only trains the grid; integrate() goes on refining it while
+    // it accumulates the estimate. N evaluations per pass.
+    template <typename F>
+    void adapt( THREAD_POOL::ThreadPool& pool, const F& f, uint64_t N, unsigned int iterations ) {
+      for( unsigned int it=0; it < iterations; ++it ) refine( run_pass( pool, f, N ).weight );
+    }
+    template <typename F>
+    VegasResult integrate( THREAD_POOL::ThreadPool& pool, const F& f, uint64_t N, unsigned int iterations ) {
+      assert( iterations > 0 );
+      std::vector<Pass> passes;
+      uint64_t evaluations = 0;
+      for( unsigned int it=0; it < iterations; ++it ) {
+	passes.push_back( run_pass( pool, f, N ) );
+	evaluations += passes.back().evaluations;
+	refine( passes.back().weight );
+      }
+      double wsum = 0, isum = 0;
+      for( const Pass& p : passes ) {
+	const double w = 1/variance_floor( p );
+	wsum += w;
+	isum += w*p.integral;
+      }
+      const double estimate = isum/wsum;
+      double chi2 = 0;
+      for( const Pass& p : passes ) chi2 += ( p.integral-estimate )*( p.integral-estimate )/variance_floor( p );
+      return VegasResult{ estimate, std::sqrt( 1/wsum ), ( iterations > 1 ) ? chi2/( iterations-1 ) : 0.0,
+			  iterations, evaluations };
+    }
+
+  private:
+    struct Pass {
+      double integral = 0, variance = 0;
+      uint64_t evaluations = 0;
+      std::vector<double> weight; // d x BINS, sum of (J f)^2
+    };
+
+    // Floor so a pass of a constant integrand (variance 0) still has a weight.
+    static double variance_floor( const Pass& p ) {
+      const double v = std::max( p.variance, 1e-28*p.integral*p.integral );
+      return ( v > 0 ) ? v : 1.0;
+    }
+
+    template <typename F>
+    Pass run_pass( THREAD_POOL::ThreadPool& pool, const F& f, uint64_t N ) {
+      // Largest ns with ns^d cubes of at least 2 samples.
+      uint64_t ns = std::max<uint64_t>( 1, static_cast<uint64_t>( std::pow( N/2.0, 1.0/d ) ) );
+      auto cubes_of = [this]( uint64_t s ) {
+	uint64_t c = 1;
+	for( unsigned int j=0; j < d; ++j ) c *= s;
+	return c;
+      };
+      while( ns > 1 && cubes_of( ns ) > N/2 ) --ns;
+      const uint64_t cubes = cubes_of( ns );
+      const uint64_t per_cube = std::max<uint64_t>( 2, N/cubes );
+      const PhiloxStream rng( seed, pass++ );
+
+      // Samples cube*per_cube .. are cube's; chunks of the sample range may
+      // split a cube, so each chunk keeps moments per cube it touched and
+      // they are folded, in order, below.
+      struct Moments { uint64_t cube; double sum, sum2; };
+      const uint64_t SAMPLES = cubes*per_cube;
+      const uint64_t CHUNKS = std::min<uint64_t>( SAMPLES, 256 );
+      std::vector< std::vector<Moments> > moments( CHUNKS );
+      std::vector< std::vector<double> > weights( CHUNKS );
+      THREAD_POOL::parallel_for( pool, uint64_t(0), CHUNKS, [&]( uint64_t c ) {
+	  std::vector<double>& weight = weights[c];
+	  weight.assign( size_t(d)*BINS, 0.0 );
+	  std::vector<double> x( d );
+	  std::vector<unsigned int> bin( d ), stratum( d );
+	  const uint64_t H = ( d+1 )/2; // counters per sample
+	  for( uint64_t i=SAMPLES*c/CHUNKS; i < SAMPLES*(c+1)/CHUNKS; ++i ) {
+	    const uint64_t cube = i/per_cube;
+	    if( moments[c].empty() || moments[c].back().cube != cube ) {
+	      moments[c].push_back( Moments{ cube, 0, 0 } );
+	      for( uint64_t q=cube, j=0; j < d; ++j, q /= ns ) stratum[j] = static_cast<unsigned int>( q % ns );
+	    }
+	    double jacobian = 1;
+	    std::pair<double,double> u;
+	    for( unsigned int j=0; j < d; ++j ) {
+	      if( !( j & 1 ) ) u = rng.uniform_pair( i*H + j/2 );
+	      const double y = ( stratum[j] + ( ( j & 1 ) ? u.second : u.first ) )/ns;
+	      const double pos = y*BINS;
+	      bin[j] = std::min( BINS-1, static_cast<unsigned int>( pos ) );
+	      const double* e = &edges[j*(BINS+1)+bin[j]];
+	      const double width = e[1]-e[0];
+	      x[j] = lower[j] + ( upper[j]-lower[j] )*( e[0] + ( pos-bin[j] )*width );
+	      jacobian *= BINS*width*( upper[j]-lower[j] );
+	    }
+	    const double fx = jacobian*call( f, x.data() );
+	    moments[c].back().sum += fx;
+	    moments[c].back().sum2 += fx*fx;
+	    for( unsigned int j=0; j < d; ++j ) weight[j*BINS+bin[j]] += fx*fx;
+	  }
+	}, uint64_t(1) );
+
+      Pass retval;
+      retval.weight.assign( size_t(d)*BINS, 0.0 );
+      retval.evaluations = SAMPLES;
+      Moments cur{ 0, 0, 0 };
+      auto finish = [&]( const Moments& m ) {
+	const double mean = m.sum/per_cube;
+	const double var = std::max( 0.0, m.sum2/per_cube - mean*mean )*per_cube/( per_cube-1 );
+	retval.integral += mean/cubes;
+	retval.variance += var/( double(per_cube)*cubes*cubes );
+      };
+      for( uint64_t c=0; c < CHUNKS; ++c ) {
+	for( const Moments& m : moments[c] ) {
+	  if( m.cube != cur.cube ) { finish( cur ); cur = m; }
+	  else { cur.sum += m.sum; cur.sum2 += m.sum2; }
+	}
+	for( size_t i=0; i < retval.weight.size(); ++i ) retval.weight[i] += weights[c][i];
+      }
+      finish( cur );
+      return retval;
+    }
+
+    template <typename F>
+    double call( const F& f, const double* x ) const {
+      if constexpr( std::is_invocable_v<const F&, const double*> ) return f( x );
+      else return f( x[0] );
+    }
+
+    // Lepage's rebinning: smooth the per bin weights, compress them with
+    // ((r-1)/ln r)^alpha, then place the new edges at equal shares.
+    void refine( const std::vector<double>& weight ) {
+      std::vector<double> r( BINS ), moved( BINS+1 );
+      for( unsigned int j=0; j < d; ++j ) {
+	const double* w = &weight[j*BINS];
+	double total = 0;
+	for( unsigned int i=0; i < BINS; ++i ) {
+	  const double lo = w[ i ? i-1 : i ], hi = w[ ( i+1 < BINS ) ? i+1 : i ];
+	  r[i] = ( i == 0 || i+1 == BINS ) ? ( w[i] + ( i ? lo : hi ) )/2 : ( lo+w[i]+hi )/3;
+	  total += r[i];
+	}
+	if( !( total > 0 ) || !std::isfinite( total ) ) continue;
+	double sum = 0;
+	for( unsigned int i=0; i < BINS; ++i ) {
+	  const double x = r[i]/total;
+	  r[i] = ( x <= 0 ) ? 0 : ( x >= 1 ) ? 1 : std::pow( ( x-1 )/std::log( x ), alpha );
+	  sum += r[i];
+	}
+	double* e = &edges[j*(BINS+1)];
+	const double share = sum/BINS;
+	double acc = 0;
+	unsigned int k = 0;
+	moved[0] = 0;
+	for( unsigned int i=1; i < BINS; ++i ) {
+	  const double target = i*share;
+	  while( k+1 < BINS && acc + r[k] < target ) acc += r[k++];
+	  const double t = ( r[k] > 0 ) ? std::min( 1.0, ( target-acc )/r[k] ) : 0.0;
+	  moved[i] = e[k] + t*( e[k+1]-e[k] );
+	}
+	moved[BINS] = 1;
+	std::copy( moved.begin(), moved.end(), e );
+      }
+    }
+
+    const std::vector<double> lower, upper;
+    const unsigned int d, BINS;
+    const double alpha;
+    const uint64_t seed;
+    uint64_t pass = 0;          // Philox stream of the next pass
+    std::vector<double> edges;  // d x (BINS+1), in [0,1]
+  };
+
+} // end of namespace MonteCarloIntegration
+
+#endif // VEGAS_H